@@ -9,12 +9,13 @@
 # "no such process" errors.
 # February 20, 2010
 
-import os, signal, time
+import os, signal, time, math, cgi
 import CGIHTTPServer, BaseHTTPServer
 
 ### Global variables
 
 serverPids = [0,0]     # list of server process IDs [web server,browser]
+MAX_TILES = 64         # most map tiles sent for one view
 
 
 ### Public functions
@@ -31,15 +32,60 @@ def startWebServer(portNum=8080):
     if (pid == 0):            # in child process
         # The website is served from public_html, and CGI programs
         # of any type (perl, python, etc) can be placed in cgi-bin
-        class Handler(CGIHTTPServer.CGIHTTPRequestHandler):
-            cgi_directories = ["/cgi-bin"]
-
         os.chdir('public_html');
-        httpd = BaseHTTPServer.HTTPServer(("", portNum), Handler)
+        httpd = BaseHTTPServer.HTTPServer(("", portNum), TileHandler)
         print "Web server on port:", portNum
         httpd.serve_forever()
         
 
+# Columns & rows of the Web Mercator tiles at zoom covering a lat/lon box,
+# as written by gpstool -tiles
+#
+def tileRange(zoom, south, west, north, east):
+    n = 2 ** zoom
+    def col(lon):
+        return min(n - 1, max(0, int((lon + 180) / 360 * n)))
+    def row(lat):
+        lat = math.radians(max(-85.0511, min(85.0511, lat)))
+        y = (1 - math.log(math.tan(lat) + 1 / math.cos(lat)) / math.pi) / 2
+        return min(n - 1, max(0, int(y * n)))
+
+    if west > east:     # box crosses the antimeridian
+        cols = range(col(west), n) + range(0, col(east) + 1)
+    else:
+        cols = range(col(west), col(east) + 1)
+    return [(x, y) for x in cols for y in range(row(north), row(south) + 1)]
+
+
+# Serves public_html, plus /tiles?z=ZOOM&bbox=S,W,N,E which returns a JSON
+# list of the trackpoint tiles in view from public_html/tiles
+#
+class TileHandler(CGIHTTPServer.CGIHTTPRequestHandler):
+    cgi_directories = ["/cgi-bin"]
+
+    def do_GET(self):
+        if not self.path.startswith('/tiles?'):
+            return CGIHTTPServer.CGIHTTPRequestHandler.do_GET(self)
+        query = cgi.parse_qs(self.path.split('?', 1)[1])
+        try:
+            zoom = int(query['z'][0])
+            south, west, north, east = [float(v) for v in query['bbox'][0].split(',')]
+        except (KeyError, ValueError):
+            return self.send_error(400, "Bad tile request")
+
+        tiles = []
+        for x, y in tileRange(zoom, south, west, north, east)[:MAX_TILES]:
+            path = 'tiles/%d/%d/%d.json' % (zoom, x, y)
+            if os.path.exists(path):
+                tiles.append(open(path).read().strip())
+        body = '[' + ',\n'.join(tiles) + ']\n'
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+
 # Kill all servers
 #
 def killServers():
@@ -171,63 +217,116 @@ def serve(path):
         });
         return line;
       }
-      GDownloadUrl("gmapdata.xml", function(doc) {
-        var xml = GXml.parse(doc);
+      // coordinates of a route or track, either an encoded polyline or an
+      // array of [lat, lon] pairs
+      function points(p) {
+        var coords = [];
+        if (typeof p != "string") {
+          for (var i = 0; i < p.length; i++)
+            coords.push(coord(p[i][0], p[i][1]));
+          return coords;
+        }
+        var lat = 0, lon = 0;
+        for (var i = 0; i < p.length;) {
+          var delta = [0, 0];
+          for (var k = 0; k < 2; k++) {
+            var shift = 0, result = 0, b;
+            do {
+              b = p.charCodeAt(i++) - 63;
+              result |= (b & 0x1f) << shift;
+              shift += 5;
+            } while (b >= 0x20);
+            delta[k] = (result & 1) ? ~(result >> 1) : (result >> 1);
+          }
+          lat += delta[0];
+          lon += delta[1];
+          coords.push(coord(lat * 1e-5, lon * 1e-5));
+        }
+        return coords;
+      }
 
-        var waypts = xml.documentElement.getElementsByTagName("waypt");
-        
+      GDownloadUrl("gmapdata.json", function(doc) {
+        var json = eval("(" + doc + ")");
+        var colors = json.colors;
+        var data = json.data;
+        var units = data.units || ["", ""];
+
+        var waypts = data.waypts || [];
         for (var i = 0; i < waypts.length; i++) {
-          var lat = parseFloat(waypts[i].getAttribute("lat"));
-          var lon = parseFloat(waypts[i].getAttribute("lon"));
-          var id = waypts[i].getAttribute("id");
-          var color = waypts[i].getAttribute("color");
-          var symbol = waypts[i].getAttribute("symbol");
-          var text = waypts[i].getAttribute("text");
-
-          map.addOverlay(marker(coord(lat, lon), id, icon(color, symbol), text));
+          var color = waypts[i].color || colors.waypt;
+          map.addOverlay(marker(coord(waypts[i].lat, waypts[i].lon), waypts[i].id, icon(color, waypts[i].symbol), waypts[i].text));
         }
-        
-        var routes = xml.documentElement.getElementsByTagName("route");
+
+        var routes = data.routes || [];
         for (var i = 0; i < routes.length; i++) {
-          var legs = [];
-          var color = routes[i].getAttribute("color");
-          var text = routes[i].getAttribute("comment");
-          var num = routes[i].getAttribute("num");
-          for (var j = 0; j < routes[i].childNodes.length; j++) {
-            var lat = parseFloat(routes[i].childNodes[j].getAttribute("lat"));
-            var lon = parseFloat(routes[i].childNodes[j].getAttribute("lon"));
-            legs.push(coord(lat, lon));
-          }
-          map.addOverlay(polyline(legs, color, "<em style='font-size: x-small'>Route</em> - <b>No. " + num + "</b><br />" + text));
+          var color = routes[i].color || colors.route;
+          map.addOverlay(polyline(points(routes[i].points), color, "<em style='font-size: x-small'>Route</em> - <b>No. " + routes[i].num + "</b><br />" + routes[i].comment));
         }
-        
-        var trkpts = xml.documentElement.getElementsByTagName("trkpt");
+
+        var trkpts = points(data.trkpts || []);
         for (var i = 0; i < trkpts.length; i++) {
-          var color = trkpts[i].getAttribute("color");
-          var lat = parseFloat(trkpts[i].getAttribute("lat"));
-          var lon = parseFloat(trkpts[i].getAttribute("lon"));
-          map.addOverlay(marker(coord(lat, lon), i, icon(color)));
+          map.addOverlay(marker(trkpts[i], i, icon(colors.trkpt)));
         }
-        
-        var tracks = xml.documentElement.getElementsByTagName("track");
+
+        var tracks = data.tracks || [];
         for (var i = 0; i < tracks.length; i++) {
-          var legs = [];
-          var color = tracks[i].getAttribute("color");
-          var dist = tracks[i].getAttribute("dist");
-          var duration = tracks[i].getAttribute("duration");
-          var seqno = tracks[i].getAttribute("seqno");
-          var speed = tracks[i].getAttribute("speed");
-          var start = tracks[1].getAttribute("start");
-          for (var j = 0; j < tracks[i].childNodes.length; j++) {
-            var lat = parseFloat(tracks[i].childNodes[j].getAttribute("lat"));
-            var lon = parseFloat(tracks[i].childNodes[j].getAttribute("lon"));
-            legs.push(coord(lat, lon));
-          }
-          map.addOverlay(polyline(legs, color, "<em style='font-size: x-small'>Track</em> - <b>Sequence No. " + seqno + "</b><br />Starts: " + start + "<br />Duration: " + duration + "<br />Distance: " + dist + "<br />Speed: " + speed));
+          var t = tracks[i];
+          var color = t.color || colors.track;
+          map.addOverlay(polyline(points(t.points), color, "<em style='font-size: x-small'>Track</em> - <b>Sequence No. " + t.seqno + "</b><br />Starts: " + t.start + "<br />Duration: " + t.duration + "<br />Distance: " + t.dist + units[0] + "<br />Speed: " + t.speed + units[1]));
         }
         map.setZoom(map.getBoundsZoomLevel(bounds));
         map.setCenter(bounds.getCenter());
+        if (json.tiles) {
+          loadTiles(json.tiles, colors);
+        }
       });
+
+      // trackpoints too many to send at once come as the tiles in view,
+      // see gpstool -tiles; sel names the tracks to draw and whether to mark
+      // the trackpoints
+      function loadTiles(sel, colors) {
+        var lines = [];
+        var chosen = {};
+        for (var i = 0; i < sel.tracks.length; i++) {
+          chosen[sel.tracks[i]] = true;
+        }
+        GDownloadUrl("tiles/tiles.json", function(doc) {
+          var info = eval("(" + doc + ")");
+          coord(info.sw[0], info.sw[1]);
+          coord(info.ne[0], info.ne[1]);
+          map.setZoom(map.getBoundsZoomLevel(bounds));
+          map.setCenter(bounds.getCenter());
+
+          function update() {
+            var view = map.getBounds();
+            var sw = view.getSouthWest(), ne = view.getNorthEast();
+            var zoom = Math.min(map.getZoom(), info.maxzoom);
+            GDownloadUrl("tiles?z=" + zoom + "&bbox=" + [sw.lat(), sw.lng(), ne.lat(), ne.lng()].join(","), function(doc) {
+              var tiles = eval("(" + doc + ")");
+              for (var i = 0; i < lines.length; i++) {
+                map.removeOverlay(lines[i]);
+              }
+              lines = [];
+              for (var i = 0; i < tiles.length; i++) {
+                for (var k = 0; k < tiles[i].lines.length; k++) {
+                  var t = tiles[i].lines[k];
+                  var coords = points(t.points);
+                  if (chosen[t.seqno]) {
+                    lines.push(polyline(coords, colors.track, "<em style='font-size: x-small'>Track</em> - <b>Sequence No. " + t.seqno + "</b>"));
+                    map.addOverlay(lines[lines.length - 1]);
+                  }
+                  for (var j = 0; sel.trkpts && j < coords.length; j++) {
+                    lines.push(marker(coords[j], t.seqno, icon(colors.trkpt)));
+                    map.addOverlay(lines[lines.length - 1]);
+                  }
+                }
+              }
+            });
+          }
+          GEvent.addListener(map, "moveend", update);
+          update();
+        });
+      }
     }
   }
   //]]>
@@ -15,18 +15,34 @@ ID #0523365
 static PyObject* Gps_readFile(PyObject *self, PyObject *args);
 static PyObject* Gps_getData(PyObject *self, PyObject *args);
 static PyObject* Gps_freeFile(PyObject *self, PyObject *args);
+static PyObject* Gps_getDistance(PyObject *self, PyObject *args);
+static PyObject* Gps_getLegDists(PyObject *self, PyObject *args);
+static PyObject* Gps_getUnitFactor(PyObject *self, PyObject *args);
+static PyObject* Gps_getNear(PyObject *self, PyObject *args);
+static PyObject* Gps_getInBox(PyObject *self, PyObject *args);
+static PyObject* Gps_simplify(PyObject *self, PyObject *args);
+static PyObject* Gps_getStats(PyObject *self, PyObject *args);
 
 /*** method list to export to python ***/
 static PyMethodDef gpsMethods[] = {
 	{"readFile", Gps_readFile, METH_VARARGS},
 	{"getData", Gps_getData, METH_VARARGS},
 	{"freeFile", Gps_freeFile, METH_VARARGS},
+	{"getDistance", Gps_getDistance, METH_VARARGS},
+	{"getLegDists", Gps_getLegDists, METH_VARARGS},
+	{"getUnitFactor", Gps_getUnitFactor, METH_VARARGS},
+	{"getNear", Gps_getNear, METH_VARARGS},
+	{"getInBox", Gps_getInBox, METH_VARARGS},
+	{"simplify", Gps_simplify, METH_VARARGS},
+	{"getStats", Gps_getStats, METH_VARARGS},
 	{NULL, NULL}, //denotes end of list
 };
 
 static GpFile filep;
 static GpTrack *tracksp;
 static int ntracks;
+static GpIndex gpindex;
+static _Bool indexed;
 
 void initGps(void) {
     Py_InitModule("Gps", gpsMethods);
@@ -121,8 +137,226 @@ static PyObject* Gps_freeFile(PyObject *self, PyObject *args) {
     GpTrack *tp = tracksp;
     tracksp = NULL;
     free(tp);
+    if (indexed) {
+        freeGpIndex(&gpindex);
+        indexed = 0;
+    }
     freeGpFile(&filep);
     
     return Py_BuildValue("s", "OK");
 }
 
+
+/*  Convert a python sequence of (lat, lon) pairs into an allocated array of
+    coordinates, storing its length in n. Returns NULL on error */
+static GpCoord *toGpCoords(PyObject *seq, int *n) {
+    PyObject *fast = PySequence_Fast(seq, "expected a sequence of coordinates");
+    GpCoord *coord;
+
+    if (fast == NULL)
+        return NULL;
+    *n = PySequence_Fast_GET_SIZE(fast);
+    coord = malloc((*n + 1) * sizeof(GpCoord));
+    if (coord == NULL) {
+        Py_DECREF(fast);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    for (int i = 0; i < *n; i++) {
+        PyObject *item = PySequence_Fast_GET_ITEM(fast, i);
+        if (PyArg_ParseTuple(item, "dd", &coord[i].lat, &coord[i].lon) == 0) {
+            free(coord);
+            Py_DECREF(fast);
+            return NULL;
+        }
+    }
+    Py_DECREF(fast);
+    return coord;
+}
+
+
+static PyObject* Gps_getDistance(PyObject *self, PyObject *args) {
+    GpCoord from, to;
+
+    if (PyArg_ParseTuple(args, "(dd)(dd)", &from.lat, &from.lon, &to.lat,
+                         &to.lon) == 0)
+        return NULL;
+    return Py_BuildValue("d", getGpDistance(from, to));
+}
+
+
+static PyObject* Gps_getLegDists(PyObject *self, PyObject *args) {
+    PyObject *seq, *dists;
+    GpCoord *coord;
+    double *dist;
+    int n;
+
+    if (PyArg_ParseTuple(args, "O", &seq) == 0)
+        return NULL;
+    if ((coord = toGpCoords(seq, &n)) == NULL)
+        return NULL;
+    dist = malloc((n + 1) * sizeof(double));
+    if (dist == NULL) {
+        free(coord);
+        return PyErr_NoMemory();
+    }
+    getGpLegDists(coord, n, dist);
+    free(coord);
+
+    dists = PyList_New(n);
+    for (int i = 0; dists != NULL && i < n; i++) {
+        PyObject *d = PyFloat_FromDouble(dist[i]);
+        if (d == NULL) {
+            Py_DECREF(dists);
+            dists = NULL;
+            break;
+        }
+        PyList_SET_ITEM(dists, i, d);
+    }
+    free(dist);
+    return dists;
+}
+
+
+static PyObject* Gps_getUnitFactor(PyObject *self, PyObject *args) {
+    char unitHorz;
+
+    if (PyArg_ParseTuple(args, "c", &unitHorz) == 0)
+        return NULL;
+    return Py_BuildValue("d", getGpUnitFactor(unitHorz));
+}
+
+
+/*  Convert an array of matches into a list of ('w' or 't', subscript, dist)
+    tuples, dist being in km. */
+static PyObject *fromGpMatches(GpMatch *mp, int n) {
+    PyObject *matches = PyList_New(n);
+
+    for (int i = 0; matches != NULL && i < n; i++) {
+        PyObject *match = Py_BuildValue("(cid)", mp[i].isTrkpt ? 't' : 'w',
+                                        mp[i].index, mp[i].dist);
+        if (match == NULL) {
+            Py_DECREF(matches);
+            matches = NULL;
+            break;
+        }
+        PyList_SET_ITEM(matches, i, match);
+    }
+    free(mp);
+    return matches;
+}
+
+
+/*  Index the open file's waypoints and trackpoints on first use  */
+static GpIndex *getIndex(void) {
+    if (!indexed) {
+        buildGpIndex(&filep, GP_CELLSIZE, &gpindex);
+        indexed = 1;
+    }
+    return &gpindex;
+}
+
+
+static PyObject* Gps_getNear(PyObject *self, PyObject *args) {
+    GpCoord centre;
+    double dist;
+    GpMatch *mp;
+    int n;
+
+    if (PyArg_ParseTuple(args, "(dd)d", &centre.lat, &centre.lon, &dist) == 0)
+        return NULL;
+    n = queryGpRadius(getIndex(), centre, dist, &mp);
+    return fromGpMatches(mp, n);
+}
+
+
+static PyObject* Gps_getInBox(PyObject *self, PyObject *args) {
+    GpCoord SW, NE;
+    GpMatch *mp;
+    int n;
+
+    if (PyArg_ParseTuple(args, "(dd)(dd)", &SW.lat, &SW.lon, &NE.lat,
+                         &NE.lon) == 0)
+        return NULL;
+    n = queryGpBox(getIndex(), SW, NE, &mp);
+    return fromGpMatches(mp, n);
+}
+
+
+static PyObject* Gps_simplify(PyObject *self, PyObject *args) {
+    PyObject *seq, *kept;
+    GpCoord *coord;
+    _Bool *keep;
+    double tolerance;
+    int n, nkept;
+
+    if (PyArg_ParseTuple(args, "Od", &seq, &tolerance) == 0)
+        return NULL;
+    if ((coord = toGpCoords(seq, &n)) == NULL)
+        return NULL;
+    keep = malloc((n + 1) * sizeof(_Bool));
+    if (keep == NULL) {
+        free(coord);
+        return PyErr_NoMemory();
+    }
+    nkept = simplifyGpPath(coord, n, tolerance, keep);
+    free(coord);
+
+    kept = PyList_New(nkept);
+    for (int i = 0, j = 0; kept != NULL && i < n; i++) {
+        if (keep[i])
+            PyList_SET_ITEM(kept, j++, PyInt_FromLong(i));
+    }
+    free(keep);
+    return kept;
+}
+
+
+/*  Statistics of each track of the open file as a list of dicts keyed by the
+    GpTrackStats field names, minAlt & maxAlt being None without altitudes.
+    Optional args are the stop speed (file's units, default 1 km/h) and the
+    speed percentile (default 95)  */
+static PyObject* Gps_getStats(PyObject *self, PyObject *args) {
+    float stopSpeed = getGpUnitFactor(filep.unitHorz)
+                      / ((filep.unitTime == 'H') ? 1 : 3600);
+    double percentile = 95;
+    GpTrackStats *sp;
+    PyObject *stats;
+    int n;
+
+    if (PyArg_ParseTuple(args, "|fd", &stopSpeed, &percentile) == 0)
+        return NULL;
+    if (percentile < 0 || percentile > 100) {
+        PyErr_SetString(PyExc_ValueError, "percentile must be 0-100");
+        return NULL;
+    }
+    n = getGpTrackStats(&filep, stopSpeed, percentile, &sp);
+
+    stats = PyList_New(n);
+    for (int i = 0; stats != NULL && i < n; i++) {
+        PyObject *minAlt = isnan(sp[i].minAlt) ? Py_BuildValue("")
+                               : PyFloat_FromDouble(sp[i].minAlt);
+        PyObject *maxAlt = isnan(sp[i].maxAlt) ? Py_BuildValue("")
+                               : PyFloat_FromDouble(sp[i].maxAlt);
+        PyObject *st = Py_BuildValue("{s:i,s:i,s:l,s:l,s:f,s:f,s:f,s:d,s:d,"
+                                     "s:N,s:N}",
+                                     "seqno", sp[i].seqno,
+                                     "npoints", sp[i].npoints,
+                                     "movingTime", sp[i].movingTime,
+                                     "stoppedTime", sp[i].stoppedTime,
+                                     "movingSpeed", sp[i].movingSpeed,
+                                     "maxSpeed", sp[i].maxSpeed,
+                                     "pctSpeed", sp[i].pctSpeed,
+                                     "climb", sp[i].climb,
+                                     "descent", sp[i].descent,
+                                     "minAlt", minAlt, "maxAlt", maxAlt);
+        if (st == NULL) {
+            Py_DECREF(stats);
+            stats = NULL;
+            break;
+        }
+        PyList_SET_ITEM(stats, i, st);
+    }
+    free(sp);
+    return stats;
+}
@@ -0,0 +1,58 @@
+#!/bin/sh
+# bench.sh -- times gpstool on synthetic GPSU files made by gpsgen
+#
+# Prints one tab-separated line per operation and size:
+#   op  trkpts  records  bytes  seconds  records/s  MB/s
+# records counts waypoints, route legs and trackpoints in the input; seconds
+# is the best of $REPS runs.  Set SIZES to the trackpoint counts wanted.
+#
+# Eric Coutu
+# 0523365
+
+SIZES=${SIZES:-"10000 100000 1000000"}
+REPS=${REPS:-3}
+DIR=${TMPDIR:-/tmp}/gpsbench.$$
+
+mkdir -p "$DIR" || exit 1
+trap 'rm -rf "$DIR"' 0 1 2 15
+
+# best elapsed time of $REPS runs of "$@" < $IN
+best() {
+    b=
+    i=0
+    while [ $i -lt "$REPS" ]; do
+        t0=$(date +%s.%N)
+        "$@" < "$IN" > "$DIR/out" 2> /dev/null || { echo "$*: failed" >&2; exit 1; }
+        t1=$(date +%s.%N)
+        b=$(echo "$t0 $t1 $b" | awk '{ t = $2 - $1; if ($3 != "" && $3 < t) t = $3; printf "%.6f", t }')
+        i=$((i + 1))
+    done
+    echo "$b"
+}
+
+report() {
+    echo "$1 $2 $3 $4 $5" | awk '{ s = ($5 > 0) ? $5 : 1e-6;
+        printf "%s\t%d\t%d\t%d\t%.6f\t%.0f\t%.2f\n", $1, $2, $3, $4, $5,
+               $3 / s, $4 / s / 1048576 }'
+}
+
+printf "op\ttrkpts\trecords\tbytes\tseconds\trecords_per_s\tMB_per_s\n"
+for n in $SIZES; do
+    w=$((n / 10))
+    r=$((n / 200 + 1))
+    IN="$DIR/in$n.gps"
+    ./gpsgen -t "$n" -w "$w" -r "$r" -l 20 -s "$n" > "$IN" || exit 1
+    recs=$((n + w + r * 20))
+    bytes=$(wc -c < "$IN")
+    report parse+write "$n" "$recs" "$bytes" "$(best ./gpstool -keep wrt)"
+    report info "$n" "$recs" "$bytes" "$(best ./gpstool -info)"
+    report sort "$n" "$recs" "$bytes" "$(best ./gpstool -sortwp)"
+    report merge "$n" "$((recs * 2))" "$((bytes * 2))" \
+        "$(best ./gpstool -merge "$IN")"
+    report tracks "$n" "$recs" "$bytes" "$(best ./gpstool -map k)"
+    report stats "$n" "$recs" "$bytes" "$(best ./gpstool -stats)"
+    # gzipped input, written back gzipped; bytes are uncompressed
+    gzip -c "$IN" > "$IN.gz" || exit 1
+    IN="$IN.gz"
+    report gz-parse+write "$n" "$recs" "$bytes" "$(best ./gpstool -keep wrt)"
+done
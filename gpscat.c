@@ -0,0 +1,453 @@
+/********
+gpscat.c -- a catalog of the tracks in a directory tree of GPSU files
+
+Eric Coutu
+ID #0523365
+********/
+
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 500
+#endif
+
+#define INDEX "gpscat.idx"      // default catalog file
+#define MAGIC "GPSCAT1\n"       // first bytes of a catalog file
+
+#include "gputil.h"
+#include "mystring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+typedef struct {    // summary of a file, as recorded in the catalog
+    char *path;         // as found under the catalogued directory
+    int64_t mtime;      // modification time & size when summarized
+    int64_t size;
+    int32_t status;     // GpError from readGpFile, only OK files have data
+    int32_t nwaypts, nroutes, ntrkpts, ntracks;
+    GpTrack *track;     // seqno, startTrk, endTrk, SW & NE corners set
+} CatFile;
+
+char *prog_name = NULL;
+
+// files found by the directory walk
+static CatFile *found = NULL;
+static int nfound = 0;
+
+
+/*  Write or read one field of a catalog record  */
+#define PUT(x) (fwrite(&(x), sizeof(x), 1, fp) == 1)
+#define GET(x) (fread(&(x), sizeof(x), 1, fp) == 1)
+
+
+/*  Write cf as a record of the catalog (or a worker's results) in fp. Fields
+    are in the host's byte order.
+    Returns:    0 on a write error, 1 otherwise  */
+static int writeCatFile( FILE *fp, const CatFile *cf ) {
+
+    uint16_t len = strlen(cf->path);
+
+    if (!(PUT(len) && fwrite(cf->path, 1, len, fp) == len && PUT(cf->mtime)
+          && PUT(cf->size) && PUT(cf->status) && PUT(cf->nwaypts)
+          && PUT(cf->nroutes) && PUT(cf->ntrkpts) && PUT(cf->ntracks)))
+        return 0;
+    for (int i = 0; i < cf->ntracks; i++) {
+        const GpTrack *tp = cf->track + i;
+        int32_t seqno = tp->seqno;
+        int64_t start = tp->startTrk, end = tp->endTrk;
+        if (!(PUT(seqno) && PUT(start) && PUT(end) && PUT(tp->SWcorner.lat)
+              && PUT(tp->SWcorner.lon) && PUT(tp->NEcorner.lat)
+              && PUT(tp->NEcorner.lon)))
+            return 0;
+    }
+    return 1;
+}
+
+
+/*  Read a record written by writeCatFile from fp into cf.
+    Returns:    0 at the end of fp or on a bad record, 1 otherwise  */
+static int readCatFile( FILE *fp, CatFile *cf ) {
+
+    uint16_t len;
+
+    memset(cf, 0, sizeof(CatFile));
+    if (GET(len) == false)
+        return 0;
+    cf->path = malloc(len + 1);
+    assert(cf->path != NULL);
+    cf->path[len] = '\0';
+    if (!(fread(cf->path, 1, len, fp) == len && GET(cf->mtime)
+          && GET(cf->size) && GET(cf->status) && GET(cf->nwaypts)
+          && GET(cf->nroutes) && GET(cf->ntrkpts) && GET(cf->ntracks)
+          && cf->ntracks >= 0)) {
+        free(cf->path);
+        return 0;
+    }
+    cf->track = calloc(cf->ntracks + 1, sizeof(GpTrack));
+    assert(cf->track != NULL);
+    for (int i = 0; i < cf->ntracks; i++) {
+        GpTrack *tp = cf->track + i;
+        int32_t seqno;
+        int64_t start, end;
+        if (!(GET(seqno) && GET(start) && GET(end) && GET(tp->SWcorner.lat)
+              && GET(tp->SWcorner.lon) && GET(tp->NEcorner.lat)
+              && GET(tp->NEcorner.lon))) {
+            free(cf->path);
+            free(cf->track);
+            return 0;
+        }
+        tp->seqno = seqno;
+        tp->startTrk = start;
+        tp->endTrk = end;
+    }
+    return 1;
+}
+
+
+static void freeCatFile( CatFile *cf ) {
+
+    free(cf->path);
+    free(cf->track);
+    cf->path = NULL;
+    cf->track = NULL;
+}
+
+
+/*  Read the catalog in fname into *files, sorted by path as written.
+    Returns:    no. of files, 0 if there is no catalog, -1 if it is not one */
+static int readCatalog( const char *fname, CatFile **files ) {
+
+    FILE *fp = fopen(fname, "rb");
+    char magic[sizeof(MAGIC)] = "";
+    int n = 0, size = 16;
+    CatFile cf;
+
+    *files = NULL;
+    if (fp == NULL)
+        return (errno == ENOENT) ? 0 : -1;
+    if (fread(magic, 1, strlen(MAGIC), fp) != strlen(MAGIC)
+        || strcmp(magic, MAGIC) != 0) {
+        fclose(fp);
+        return -1;
+    }
+    *files = malloc(size * sizeof(CatFile));
+    assert(*files != NULL);
+    while (readCatFile(fp, &cf) == 1) {
+        if (n == size) {
+            size *= 2;
+            *files = realloc(*files, size * sizeof(CatFile));
+            assert(*files != NULL);
+        }
+        (*files)[n++] = cf;
+    }
+    fclose(fp);
+    return n;
+}
+
+
+static int compCatPath( const void *a, const void *b ) {
+
+    return strcmp(((const CatFile *)a)->path, ((const CatFile *)b)->path);
+}
+
+
+/*  Note a GPSU file, plain or gzipped, found by nftw  */
+static int foundFile( const char *path, const struct stat *sb, int type,
+                      struct FTW *ftwbuf ) {
+
+    size_t len = strlen(path);
+    static int size = 0;
+
+    if (type != FTW_F || !((len > 4 && strcmp(path + len - 4, ".gps") == 0)
+                           || (len > 7 && strcmp(path + len - 7, ".gps.gz")
+                                          == 0)))
+        return 0;
+    if (nfound == size) {
+        size = (size == 0) ? 64 : size * 2;
+        found = realloc(found, size * sizeof(CatFile));
+        assert(found != NULL);
+    }
+    memset(found + nfound, 0, sizeof(CatFile));
+    found[nfound].path = newstr((char *)path);
+    found[nfound].mtime = sb->st_mtime;
+    found[nfound].size = sb->st_size;
+    nfound++;
+    return 0;
+}
+
+
+/*  Read the file cf names and fill in its summary  */
+static void summarize( CatFile *cf ) {
+
+    FILE *fp = fopen(cf->path, "r");
+    GpFile file;
+    GpStatus status;
+
+    if (fp == NULL) {
+        cf->status = IOERR;
+        return;
+    }
+    status = readGpFile(fp, &file);
+    fclose(fp);
+    cf->status = status.code;
+    if (status.code != OK)
+        return;
+
+    cf->nwaypts = file.nwaypts;
+    cf->nroutes = file.nroutes;
+    cf->ntrkpts = file.ntrkpts;
+    cf->ntracks = getGpTracks(&file, &cf->track);
+    freeGpFile(&file);
+}
+
+
+/*  Summarize the files in cf[0..n-1] that are flagged in todo, split among
+    nworkers processes each writing its summaries to a temporary file.
+    Returns:    0 if a worker could not be started or its results read  */
+static int summarizeAll( CatFile *cf, int n, const _Bool *todo,
+                         int nworkers ) {
+
+    FILE *results[nworkers];
+    pid_t pid[nworkers];
+    int rv = 1;
+
+    fflush(NULL);
+    for (int w = 0; w < nworkers; w++) {
+        if ( (results[w] = tmpfile()) == NULL
+            || (pid[w] = fork()) == -1) {
+            perror(prog_name);
+            nworkers = w;
+            rv = 0;
+            break;
+        }
+        else if (pid[w] == 0) {
+            int k = 0;
+            for (int i = 0; i < n; i++) {
+                if (todo[i] == true && k++ % nworkers == w) {
+                    summarize(cf + i);
+                    if (writeCatFile(results[w], cf + i) == 0)
+                        _exit(EXIT_FAILURE);
+                }
+            }
+            _exit((fflush(results[w]) == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+
+    // collect the summaries in the order they were handed out
+    for (int w = 0; w < nworkers; w++) {
+        int status;
+        if (waitpid(pid[w], &status, 0) == -1 || WIFEXITED(status) == false
+            || WEXITSTATUS(status) != EXIT_SUCCESS)
+            rv = 0;
+        rewind(results[w]);
+    }
+    for (int i = 0, k = 0; i < n && rv == 1; i++) {
+        CatFile summary;
+        if (todo[i] == false)
+            continue;
+        if (readCatFile(results[k++ % nworkers], &summary) == 0) {
+            rv = 0;
+            break;
+        }
+        freeCatFile(cf + i);
+        cf[i] = summary;
+    }
+    for (int w = 0; w < nworkers; w++)
+        fclose(results[w]);
+    return rv;
+}
+
+
+/*  Bring the catalog in fname up to date with the GPSU files under dir,
+    summarizing only the files that are new or changed since it was written  */
+static int build( const char *dir, const char *fname ) {
+
+    CatFile *old;
+    int nold = readCatalog(fname, &old);
+    int nworkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int nchanged = 0, ntracks = 0, rv = EXIT_SUCCESS;
+    char tmpname[strlen(fname) + 8];
+    _Bool *todo;
+    FILE *fp;
+
+    if (nold < 0) {
+        fprintf(stderr, "%s: %s: not a catalog\n", prog_name, fname);
+        return EXIT_FAILURE;
+    }
+    if (nftw(dir, foundFile, 16, FTW_PHYS) != 0) {
+        perror(dir);
+        return EXIT_FAILURE;
+    }
+    if (nfound > 1)
+        qsort(found, nfound, sizeof(CatFile), compCatPath);
+
+    // keep the summaries of unchanged files
+    todo = malloc((nfound + 1) * sizeof(_Bool));
+    assert(todo != NULL);
+    for (int i = 0; i < nfound; i++) {
+        CatFile *cf = (nold > 0) ? bsearch(found + i, old, nold,
+                                           sizeof(CatFile), compCatPath)
+                                 : NULL;
+        todo[i] = (cf == NULL || cf->mtime != found[i].mtime
+                   || cf->size != found[i].size);
+        if (todo[i] == false) {
+            char *path = found[i].path;
+            found[i] = *cf;
+            found[i].path = path;
+            cf->track = NULL;
+        }
+        else {
+            nchanged++;
+        }
+    }
+    for (int i = 0; i < nold; i++)
+        freeCatFile(old + i);
+    free(old);
+
+    if (nworkers < 1)
+        nworkers = 1;
+    if (nworkers > nchanged)
+        nworkers = nchanged;
+    if (nchanged > 0 && summarizeAll(found, nfound, todo, nworkers) == 0) {
+        fprintf(stderr, "%s: failed summarizing files\n", prog_name);
+        rv = EXIT_FAILURE;
+    }
+
+    // replace the catalog only once the new one is written
+    sprintf(tmpname, "%s.new", fname);
+    if (rv == EXIT_SUCCESS) {
+        if ( (fp = fopen(tmpname, "wb")) == NULL) {
+            perror(tmpname);
+            rv = EXIT_FAILURE;
+        }
+        else {
+            int ok = fwrite(MAGIC, 1, strlen(MAGIC), fp) == strlen(MAGIC);
+            for (int i = 0; i < nfound && ok; i++) {
+                ok = writeCatFile(fp, found + i);
+                ntracks += found[i].ntracks;
+            }
+            if (fclose(fp) != 0 || ok == 0 || rename(tmpname, fname) != 0) {
+                perror(fname);
+                remove(tmpname);
+                rv = EXIT_FAILURE;
+            }
+        }
+    }
+    if (rv == EXIT_SUCCESS)
+        printf("%d files (%d summarized), %d tracks in %s\n", nfound,
+               nchanged, ntracks, fname);
+
+    for (int i = 0; i < nfound; i++) {
+        if (todo[i] == true && found[i].status != OK)
+            fprintf(stderr, "%s: %s: not read: error %d\n", prog_name,
+                    found[i].path, found[i].status);
+        freeCatFile(found + i);
+    }
+    free(found);
+    free(todo);
+    return rv;
+}
+
+
+/*  Write the tracks in the catalog in fname that could pass filter, as
+    PATH SEQNO START END, from the summaries alone  */
+static int query( const char *filter, const char *fname ) {
+
+    GpTrkptFilter spec;
+    FILE *fp;
+    char magic[sizeof(MAGIC)] = "";
+    CatFile cf;
+    int rv = EXIT_SUCCESS;
+
+    if (parseGpTrkptFilter(filter, &spec) == 0) {
+        fprintf(stderr, "%s: invalid filter: %s\n", prog_name, filter);
+        return EXIT_FAILURE;
+    }
+    if ( (fp = fopen(fname, "rb")) == NULL) {
+        perror(fname);
+        return EXIT_FAILURE;
+    }
+    if (fread(magic, 1, strlen(MAGIC), fp) != strlen(MAGIC)
+        || strcmp(magic, MAGIC) != 0) {
+        fprintf(stderr, "%s: %s: not a catalog\n", prog_name, fname);
+        fclose(fp);
+        return EXIT_FAILURE;
+    }
+
+    while (rv == EXIT_SUCCESS && readCatFile(fp, &cf) == 1) {
+        for (int i = 0; i < cf.ntracks; i++) {
+            char start[32], end[32];
+            if (overlapsGpTrack(cf.track + i, &spec) == false)
+                continue;
+            strftime(start, sizeof(start), "%Y-%m-%dT%H:%M:%S",
+                     localtime(&cf.track[i].startTrk));
+            strftime(end, sizeof(end), "%Y-%m-%dT%H:%M:%S",
+                     localtime(&cf.track[i].endTrk));
+            if (printf("%s %d %s %s\n", cf.path, cf.track[i].seqno, start,
+                       end) < 0)
+                rv = EXIT_FAILURE;
+        }
+        freeCatFile(&cf);
+    }
+    fclose(fp);
+    return rv;
+}
+
+
+static void usage( void ) {
+
+    fprintf(stderr, "Usage: %s [-i INDEX] -b DIR\n"
+        "       %s [-i INDEX] -q FILTER\n"
+        "Catalog the tracks of the GPSU files (.gps or .gps.gz) under a"
+        " directory.\n"
+        "  -b DIR      add new or changed files under DIR to the catalog,"
+        " dropping\n"
+        "              files no longer there\n"
+        "  -q FILTER   list the tracks whose time span and bounding box"
+        " meet FILTER,\n"
+        "              as PATH SEQNO START END, without reading the files\n"
+        "  -i INDEX    catalog file (default " INDEX ")\n"
+        "FILTER is as for gpstool -filter: FROM..TO and/or"
+        " SLAT,WLON,NLAT,ELON,\n"
+        "separated by '/', times as YYYY-MM-DD[THH:MM[:SS]]\n",
+        prog_name, prog_name);
+}
+
+
+int main( int argc, char *argv[] ) {
+
+    char *index = INDEX, *dir = NULL, *filter = NULL;
+    int c;
+
+    prog_name = argv[0];
+    while ((c = getopt(argc, argv, "i:b:q:")) != -1) {
+        switch (c) {
+            case 'i':
+                index = optarg;
+                break;
+            case 'b':
+                dir = optarg;
+                break;
+            case 'q':
+                filter = optarg;
+                break;
+            default:
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind < argc || (dir == NULL) == (filter == NULL)) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    return (dir != NULL) ? build(dir, index) : query(filter, index);
+}
@@ -0,0 +1,229 @@
+/********
+gpsgen.c -- generates synthetic GPSU files for benchmarking gpstool
+
+Eric Coutu
+ID #0523365
+********/
+
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 1000
+#endif
+
+#define BUFSIZE 64
+#define SEGMAX 86399    // longest segment (sec.), durations are hh:mm:ss
+
+#include "gputil.h"
+#include "mystring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <getopt.h>
+#include <unistd.h>
+
+static uint64_t seed = 1;
+
+/*  Deterministic pseudo-random no. in [0, 1) (xorshift64*), so the same
+    options always give the same file  */
+static double rnd( void ) {
+
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return (double)((seed * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+
+static char *words[] = { "North", "South", "Main", "King", "Queen", "Park",
+    "Mill", "Bridge", "Church", "Station", "Harbour", "Hill", "Lake", "Road",
+    "Street", "Marina", "Pier", "Point", "Bay", "Gardens" };
+static char *symbols[] = { "Waypoint", "Bus", "House", "Boat", "Flag", "Car",
+    "Fuel", "Info", "Parking", "Restaurant" };
+
+#define NWORDS (sizeof(words) / sizeof(words[0]))
+#define NSYMBOLS (sizeof(symbols) / sizeof(symbols[0]))
+
+
+static void usage( const char *prog_name ) {
+
+    fprintf(stderr, "Usage: %s [OPTION]...\n"
+        "Write a synthetic GPSU file to standard output.\n"
+        "  -w N      no. of waypoints (default 1000)\n"
+        "  -r N      no. of routes (default 10)\n"
+        "  -l N      no. of legs per route (default 20)\n"
+        "  -t N      no. of trackpoints (default 10000)\n"
+        "  -g N      no. of trackpoints per track (default 1000)\n"
+        "  -u UNIT   horizontal unit, one of M K F N S (default K)\n"
+        "  -d FORMAT date format, dd/{mm|mmm}/{yy|yyyy} (default dd/mm/yy)\n"
+        "  -a        include altitudes\n"
+        "  -c        leave out waypoint symbols and comments\n"
+        "  -s SEED   random seed (default 1)\n", prog_name);
+}
+
+
+int main( int argc, char *argv[] ) {
+
+    long nwaypts = 1000, nroutes = 10, nlegs = 20, ntrkpts = 10000;
+    long segLen = 1000;
+    char unitHorz = 'K', dateFormat[BUFSIZE] = "%d/%m/%y";
+    _Bool alt = false, bare = false;
+    GpFile file = { dateFormat, -5, 'K', 'H', 0, NULL, 0, NULL, 0, NULL };
+    GpCoord origin = { 43.5, -80.25 };
+    struct tm tm = { 0 };
+    int c;
+
+    while ((c = getopt(argc, argv, "w:r:l:t:g:u:d:acs:")) != -1) {
+        switch (c) {
+            case 'w':
+                nwaypts = atol(optarg);
+                break;
+            case 'r':
+                nroutes = atol(optarg);
+                break;
+            case 'l':
+                nlegs = atol(optarg);
+                break;
+            case 't':
+                ntrkpts = atol(optarg);
+                break;
+            case 'g':
+                segLen = atol(optarg);
+                break;
+            case 'u':
+                unitHorz = optarg[0];
+                break;
+            case 'd':
+                sprintf(dateFormat, "%%d/%%%c/%%%c",
+                        (strstr(optarg, "mmm") != NULL) ? 'b' : 'm',
+                        (strstr(optarg, "yyyy") != NULL) ? 'Y' : 'y');
+                break;
+            case 'a':
+                alt = true;
+                break;
+            case 'c':
+                bare = true;
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind < argc || nwaypts < 0 || nroutes < 0 || nlegs < 1
+        || ntrkpts < 0 || segLen < 2 || chrset(unitHorz, "MKFNS") == false
+        || (nroutes > 0 && nwaypts == 0)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (seed == 0)
+        seed = 1;
+    file.unitHorz = unitHorz;
+    file.unitTime = chrset(unitHorz, "FM") ? 'S' : 'H';
+
+    // waypoints scattered over about 50 km. around the origin
+    file.nwaypts = nwaypts;
+    file.waypt = malloc((nwaypts + 1) * sizeof(GpWaypt));
+    assert(file.waypt != NULL);
+    for (long i = 0; i < nwaypts; i++) {
+        GpWaypt *wp = file.waypt + i;
+        char buf[BUFSIZE];
+
+        // random prefix so the waypoints need sorting
+        sprintf(buf, "%c%c%06ld", 'A' + (int)(rnd() * 26),
+                'A' + (int)(rnd() * 26), i);
+        wp->ID = newstr(buf);
+        wp->coord.lat = origin.lat + (rnd() - 0.5) * 0.5;
+        wp->coord.lon = origin.lon + (rnd() - 0.5) * 0.7;
+        wp->textChoice = "-IC&+^"[(int)(rnd() * 6)];
+        wp->textPlace = (short)(rnd() * 8);
+        sprintf(buf, "%s %s", words[(int)(rnd() * NWORDS)],
+                words[(int)(rnd() * NWORDS)]);
+        wp->symbol = newstr(bare ? "" : symbols[(int)(rnd() * NSYMBOLS)]);
+        wp->comment = newstr(bare ? "" : buf);
+    }
+
+    // routes through random waypoints
+    file.nroutes = nroutes;
+    file.route = malloc((nroutes + 1) * sizeof(GpRoute *));
+    assert(file.route != NULL);
+    for (long i = 0; i < nroutes; i++) {
+        GpRoute *rp = malloc(sizeof(GpRoute) + nlegs * sizeof(int));
+        char buf[BUFSIZE];
+
+        assert(rp != NULL);
+        rp->number = (int)i + 1;
+        sprintf(buf, "%s - %s", words[(int)(rnd() * NWORDS)],
+                words[(int)(rnd() * NWORDS)]);
+        rp->comment = newstr(buf);
+        rp->npoints = (int)nlegs;
+        for (long j = 0; j < nlegs; j++)
+            rp->leg[j] = (int)(rnd() * nwaypts);
+        file.route[i] = rp;
+    }
+
+    // tracks as random walks, logged every 1-5 sec.
+    tm.tm_year = 110;
+    tm.tm_mon = 2;
+    tm.tm_mday = 19;
+    tm.tm_hour = 8;
+    tm.tm_isdst = -1;
+    file.ntrkpts = ntrkpts;
+    file.trkpt = calloc(ntrkpts + 1, sizeof(GpTrkpt));
+    assert(file.trkpt != NULL);
+    {
+        double factor = getGpUnitFactor(unitHorz);
+        double perSec = (file.unitTime == 'H') ? 3600 : 1;
+        double heading = 0, height = 300;
+        time_t now = mktime(&tm), start = now;
+        GpCoord pos = origin;
+        long n = 0;
+
+        for (long i = 0; i < ntrkpts; i++) {
+            GpTrkpt *tp = file.trkpt + i;
+            long step = 1 + (long)(rnd() * 5);
+
+            if (n == segLen || n == 0 || now + step - start > SEGMAX) {
+                now += 3600;    // an hour between tracks
+                start = now;
+                tp->segFlag = true;
+                tp->comment = newstr(words[(int)(rnd() * NWORDS)]);
+                n = 0;
+            }
+            else {
+                double km = step * (1 + rnd() * 4) / 3600;    // 1-5 m/s
+                double leg;
+                heading += (rnd() - 0.5) * 0.6;
+                pos.lat += km / 111.2 * cos(heading);
+                pos.lon += km / (111.2 * cos(pos.lat * M_PI / 180))
+                           * sin(heading);
+                now += step;
+                tp->coord.lat = round(pos.lat * 1e6) / 1e6;
+                tp->coord.lon = round(pos.lon * 1e6) / 1e6;
+                // derived fields from the coordinates as written
+                leg = getGpDistance(tp[-1].coord, tp->coord) * factor;
+                tp->dist = tp[-1].dist + leg;
+                tp->speed = (float)(leg / step * perSec);
+                tp->duration = (long)(now - start);
+            }
+            if (tp->segFlag == true) {
+                tp->coord.lat = round(pos.lat * 1e6) / 1e6;
+                tp->coord.lon = round(pos.lon * 1e6) / 1e6;
+            }
+            height += (rnd() - 0.5) * 4;
+            tp->alt = alt ? round(height * 10) / 10 : NAN;
+            tp->dateTime = now;
+            n++;
+        }
+    }
+
+    c = writeGpFile(stdout, &file);
+    if (c == 0)
+        perror(argv[0]);
+    file.dateFormat = NULL;     // not malloc'd
+    freeGpFile(&file);
+    return (c == 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
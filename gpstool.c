@@ -23,6 +23,12 @@ ID #0523365
 #define MAX(a, b) (a > b ? a : b)
 
 #define BUFSIZE 1024
+#define DUP_SECS 1      // trackpoints merged by time are duplicates within
+#define DUP_KM 0.01     //  this time & distance of each other
+#define FOLLOW_SECS 1   // how often -follow looks for more lines
+#define OUTBUFSIZE (256 * 1024)     // output buffer for -import & -export
+#define HASHMAGIC "GPSHASH1"        // start of a -dedupe hash file
+#define HASHMAGICLEN 8
 
 #include "gpstool.h"
 #include "mystring.h"
@@ -32,9 +38,13 @@ ID #0523365
 #include <stdarg.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <math.h>
 #include <getopt.h>
 #include <unistd.h>
 #include <error.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <time.h>
 
 typedef enum {
     MISSING = 0,
@@ -44,7 +54,8 @@ typedef enum {
     HELP,
     WRITE,
     EMPTYFILE,
-    SORT
+    SORT,
+    ARGUMENT
 } errorCode;
 
 char errorCodes[][48] = {
@@ -55,16 +66,20 @@ char errorCodes[][48] = {
     "",
     "unable to write to file",
     "no data left to write",
-    "failed sorting waypoints"
+    "failed sorting waypoints",
+    "invalid command argument"
 };
 
 char *prog_name = NULL;
 GpFile *gpfileA = NULL;
+FILE *gpin = NULL;      // standard input, uncompressed
 
 void cleanUp() {
 
     freeGpFile(gpfileA);
     free(gpfileA);
+    if (gpin != NULL && gpin != stdin)
+        fclose(gpin);
 }
 
 int perr(char *format, ...) {
@@ -79,6 +94,14 @@ int perr(char *format, ...) {
     return rv;
 }
 
+/*  Print the time spent in each phase of gputil on stderr, at exit  */
+void printProfile() {
+
+    GpProfile prof;
+    if (getGpProfile(&prof) == true)
+        writeGpProfile(stderr, &prof);
+}
+
 void disperr(errorCode err) {
 
     if (err != HELP)
@@ -96,6 +119,23 @@ int main(int argc, char *argv[]) {
         { "discard",    required_argument,  0, 'd' },
         { "keep",       required_argument,  0, 'k' },
         { "merge",      required_argument,  0, 'm' },
+        { "near",       required_argument,  0, 'n' },
+        { "simplify",   required_argument,  0, 'p' },
+        { "map",        required_argument,  0, 'g' },
+        { "tiles",      required_argument,  0, 't' },
+        { "filter",     required_argument,  0, 'f' },
+        { "resample",   required_argument,  0, 'r' },
+        { "recompute",  required_argument,  0, 'c' },
+        { "segment",    required_argument,  0, 'e' },
+        { "stats",      no_argument,        0, 'a' },
+        { "mergetime",  required_argument,  0, 'x' },
+        { "sortby",     required_argument,  0, 'b' },
+        { "follow",     required_argument,  0, 'o' },
+        { "columnar",   required_argument,  0, 'l' },
+        { "import",     required_argument,  0, 'j' },
+        { "export",     required_argument,  0, 'y' },
+        { "validate",   no_argument,        0, 'v' },
+        { "dedupe",     required_argument,  0, 'u' },
         #ifndef NDEBUG
         { "write",      no_argument,        0, 'w' },
         #endif
@@ -103,11 +143,26 @@ int main(int argc, char *argv[]) {
     };
     char buf[BUFSIZE];
     int index = 0;
-    int command = getopt_long_only(argc, argv, "i:s:d:k:m:", options, &index);
+    // -profile may come before any command
+    _Bool profile = (argc > 1) && (strcmp(argv[1], "-profile") == 0);
+    if (profile == true) {
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+    int command = getopt_long_only(argc, argv, "i:s:d:k:m:n:p:g:t:f:r:c:e:a:x:b:o:l:j:y:vu:", options, &index);
     
     prog_name = argv[0];
     if (atexit (cleanUp) != 0)
         return EXIT_FAILURE;
+    if (profile == true) {
+        GpProfile prof;
+        if (getGpProfile(&prof) == false)
+            perr("%s: -profile: built without GP_PROFILE, rebuild with "
+                 "'make clean; make PROFILE=1'\n", prog_name);
+        else if (atexit(printProfile) != 0)
+            return EXIT_FAILURE;
+    }
     
     if (optind < argc) {
         disperr(EXTRA);
@@ -126,11 +181,11 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
 
-    if (chrset(command, "dkm") == true)
+    if (chrset(command, "dkmnpgtfrcexboljyu") == true)
         strcpy(buf, optarg);
 
     if (command == 'h') {
-        printf("Usage: %s COMMAND\n"
+        printf("Usage: %s [-profile] COMMAND\n"
                "A tool for manipulating GPSU formatted files.\n"
                "COMMAND is one of the following:\n"
                "  -d, -discard COMPONENT     remove specified component(s)\n"
@@ -138,7 +193,57 @@ int main(int argc, char *argv[]) {
                                              " those specified\n"
                "  -s, -sortwp                sort waypoints by ID, if not"
                                              " already\n"
+               "  -b, -sortby KEYS           sort waypoints by KEYS, equal"
+                                             " waypoints keeping their"
+                                             " order\n"
                "  -m, -merge FILE            combine data from input w/ FILE\n"
+               "  -x, -mergetime FILE        combine data from input w/ FILE,"
+                                             " merging trackpoints by time"
+                                             " and dropping duplicates\n"
+               "  -n, -near LAT,LON,DIST     list waypoints and trackpoints"
+                                             " within DIST (file's units)"
+                                             " of LAT,LON\n"
+               "  -p, -simplify TOLERANCE    drop trackpoints within"
+                                             " TOLERANCE (file's units) of"
+                                             " their simplified track\n"
+               "  -g, -map SELECTION         write selected components as"
+                                             " JSON map data\n"
+               "  -t, -tiles DIR[,SELECTION] write trackpoints as a pyramid"
+                                             " of JSON map tiles in DIR,"
+                                             " only the selected tracks'"
+                                             " if given (k, kN and t"
+                                             " only)\n"
+               "  -f, -filter FILTER         keep only the trackpoints"
+                                             " passing FILTER\n"
+               "  -r, -resample STEP         resample tracks at a uniform"
+                                             " STEP\n"
+               "  -c, -recompute {r|w}[TOL]  report (r) or rewrite (w)"
+                                             " trackpoint distances, speeds"
+                                             " and durations off by more"
+                                             " than TOL (fraction, default"
+                                             " 0.01) from the coordinates"
+                                             " and times\n"
+               "  -e, -segment SPLIT         split tracks at gaps, stops"
+                                             " and jumps\n"
+               "  -a, -stats                 moving & stopped time, top"
+                                             " speeds and climb per track\n"
+               "  -o, -follow FILE           read FILE as it grows, writing"
+                                             " a summary of each track as"
+                                             " trackpoints are added\n"
+               "  -l, -columnar FILE         write trackpoints to FILE as"
+                                             " binary columns in chunks,"
+                                             " with each chunk's min & max\n"
+               "  -j, -import FORMAT         read FORMAT (gpx or csv)"
+                                             " instead of GPSU\n"
+               "  -y, -export FORMAT         write FORMAT (gpx or csv)"
+                                             " instead of GPSU\n"
+               "  -v, -validate              list every line in error on"
+                                             " standard error, writing the"
+                                             " rest of the file\n"
+               "  -u, -dedupe HASHFILE       drop tracks already hashed in"
+                                             " HASHFILE or earlier in the"
+                                             " input, adding the rest's"
+                                             " hashes to HASHFILE\n"
                "COMPONENT is one or more of the letters: (in any order)\n"
                "   w    designates waypoints (note that discarding waypoints"
                         " will also discard routes)\n"
@@ -146,36 +251,124 @@ int main(int argc, char *argv[]) {
                         " keep waypoints)\n"
                "   t    designates trackpoints (note that discarding"
                         " trackpoints will also discard tracks)\n"
+               "SELECTION is a comma separated list of:\n"
+               "   w    all waypoints\n"
+               "   t    all trackpoints\n"
+               "   r    all routes, or rN for route number N\n"
+               "   k    all tracks, or kN for the track starting at"
+                        " trackpoint N\n"
+               "   dTOL simplify trackpoints and tracks to within TOL"
+                        " (file's units)\n"
+               "FILTER is a time window and/or a box, separated by '/':\n"
+               "   FROM..TO             times as YYYY-MM-DD[THH:MM[:SS]],"
+                                        " either may be left out\n"
+               "   SLAT,WLON,NLAT,ELON  south-west & north-east corners\n"
+               "KEYS is a comma separated list of:\n"
+               "   i, s, c     ID, symbol, comment\n"
+               "   dLAT:LON    distance from LAT,LON\n"
+               "   h           position along a Hilbert curve (nearby"
+                        " waypoints together)\n"
+               "STEP is one of:\n"
+               "   tSEC every SEC seconds\n"
+               "   dDIST every DIST (file's units)\n"
+               "   nMAX at most MAX trackpoints per track, evenly spaced\n"
+               "SPLIT is a comma separated list of:\n"
+               "   gSEC      time gaps over SEC seconds\n"
+               "   sSEC:DIST stops of SEC seconds or more within DIST"
+                        " (file's units)\n"
+               "   jDIST     jumps over DIST (file's units) between"
+                        " trackpoints\n"
+               "-profile prints the time spent reading and writing, by"
+               " phase, on standard error (needs a GP_PROFILE build)\n"
                "Note: when discarding/keeping components, there must be at"
                " least one component left in the file.\n"
                "Examples:\n"
                "  %s -discard w      discard waypoints and routes\n"
                "  %s -keep rt        discard routes and trackpoints\n"
-               "  %s -discard wrt    leaves an empty file and is invalid\n",
-               prog_name, prog_name, prog_name, prog_name);
+               "  %s -discard wrt    leaves an empty file and is invalid\n"
+               "  %s -near 50.7,-1.3,2   points within 2 units of"
+                                         " N50.7 W1.3\n"
+               "  %s -filter 2010-03-19T12:00..2010-03-19T18:00/43.4,-80.3,"
+                                         "43.6,-80.1\n",
+               prog_name, prog_name, prog_name, prog_name, prog_name,
+               prog_name);
         return EXIT_SUCCESS;
     }
+    else if (command == 'o') {
+        // reads FILE, not standard input
+        return gpsFollow(stdout, buf);
+    }
+
+    else if (chrset(command, "jy") == true) {
+        if (strcmp(buf, "gpx") != 0 && strcmp(buf, "csv") != 0) {
+            disperr(ARGUMENT);
+            return EXIT_FAILURE;
+        }
+        // whole files are converted, so write in large blocks
+        setvbuf(stdout, NULL, _IOFBF, OUTBUFSIZE);
+    }
+
+    // compressed input gives output compressed the same way
+    GpCompression how = GP_PLAIN;
+    if ((gpin = openGpInput(stdin, &how)) == NULL) {
+        perr("%s: %s\n", prog_name, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if (command == 'i') {
+        // counts only, no need to read the whole file
+        GpFileInfo info;
+        GpStatus rv = scanGpFileInfo(gpin, &info);
+        if (rv.code != OK) {
+            perr("Input error: line %d: %s\n", rv.lineno, codes[rv.code]);
+            return EXIT_FAILURE;
+        }
+        return gpsInfo(stdout, &info);
+    }
+    int nbad = 0;       // lines skipped by -validate
+    if (command == 'v') {
+        GpStatus *diag;
+        gpfileA = calloc(1, sizeof(GpFile));
+        assert(gpfileA != NULL);
+        nbad = readGpFileLenient(gpin, gpfileA, &diag);
+        for (int i = 0; i < nbad; i++)
+            perr("Input error: line %d: %s\n", diag[i].lineno,
+                 codes[diag[i].code]);
+        if (nbad > 0)
+            perr("%s: %d line%s in error skipped\n", prog_name, nbad,
+                 (nbad == 1) ? "" : "s");
+        free(diag);
+    }
     else {
         gpfileA = calloc(1, sizeof(GpFile));
         assert(gpfileA != NULL);
-        GpStatus rv = readGpFile(stdin, gpfileA);
+        GpStatus rv;
+        if (command == 'j')
+            rv = (buf[0] == 'g') ? readGpGpx(gpin, gpfileA)
+                                 : readGpCsv(gpin, gpfileA);
+        else
+            rv = readGpFile(gpin, gpfileA);
         if (rv.code != OK) {
             perr("Input error: line %d: %s\n", rv.lineno, codes[rv.code]);
             return EXIT_FAILURE;
         }
     }
 
+    _Bool report = chrset(command, "ngtal");
     switch (command) {
         case 'w':
-            break;
-        case 'i':
-            if (gpsInfo(stdout, gpfileA) == EXIT_FAILURE)
-                return EXIT_FAILURE;
+        case 'j':
+        case 'y':
+        case 'v':
             break;
         case 's':
             if (gpsSort(gpfileA) == EXIT_FAILURE)
                 return EXIT_FAILURE;
             break;
+        case 'b':
+            if (gpsSortBy(gpfileA, buf) == EXIT_FAILURE)
+                return EXIT_FAILURE;
+            break;
         case 'k': ;
             // components to discard, bitwise ORed: 111 = wrt
             char components = 0x7;
@@ -210,52 +403,97 @@ int main(int argc, char *argv[]) {
             if (gpsMerge(gpfileA, buf) == EXIT_FAILURE)
                 return EXIT_FAILURE;
             break;
+        case 'x':
+            if (gpsMergeTime(gpfileA, buf) == EXIT_FAILURE)
+                return EXIT_FAILURE;
+            break;
+        case 'n':
+            if (gpsNear(stdout, gpfileA, buf) == EXIT_FAILURE)
+                return EXIT_FAILURE;
+            break;
+        case 'p':
+            if (gpsSimplify(gpfileA, buf) == EXIT_FAILURE)
+                return EXIT_FAILURE;
+            break;
+        case 'g':
+            if (gpsMapData(stdout, gpfileA, buf) == EXIT_FAILURE)
+                return EXIT_FAILURE;
+            break;
+        case 't':
+            if (gpsTiles(stdout, gpfileA, buf) == EXIT_FAILURE)
+                return EXIT_FAILURE;
+            break;
+        case 'l':
+            if (gpsColumnar(stdout, gpfileA, buf) == EXIT_FAILURE)
+                return EXIT_FAILURE;
+            break;
+        case 'u':
+            if (gpsDedupe(gpfileA, buf) == EXIT_FAILURE)
+                return EXIT_FAILURE;
+            break;
+        case 'f':
+            if (gpsFilter(gpfileA, buf) == EXIT_FAILURE)
+                return EXIT_FAILURE;
+            break;
+        case 'r':
+            if (gpsResample(gpfileA, buf) == EXIT_FAILURE)
+                return EXIT_FAILURE;
+            break;
+        case 'a':
+            if (gpsStats(stdout, gpfileA) == EXIT_FAILURE)
+                return EXIT_FAILURE;
+            break;
+        case 'e':
+            if (gpsSegment(gpfileA, buf) == EXIT_FAILURE)
+                return EXIT_FAILURE;
+            break;
+        case 'c':
+            report = (buf[0] == 'r');
+            if (gpsRecompute(stdout, gpfileA, buf) == EXIT_FAILURE)
+                return EXIT_FAILURE;
+            break;
         default:
             disperr(HELP);
             return EXIT_FAILURE;
     }
     
-    if (command != 'i') {
-        int rv = writeGpFile(stdout, gpfileA);
+    if (report == false) {
+        FILE *out = openGpOutput(stdout, how);
+        int rv = 0;
+        if (out != NULL && command == 'y')
+            rv = (buf[0] == 'g') ? writeGpGpx(out, gpfileA)
+                                 : writeGpCsv(out, gpfileA);
+        else if (out != NULL)
+            rv = writeGpFile(out, gpfileA);
         PDEB("writeGpFile returned %d", rv);
+        if (out != NULL && out != stdout && fclose(out) != 0)
+            rv = 0;
         if (rv == 0) {
             disperr(WRITE);
             return EXIT_FAILURE;
         }
     }
+    // -dedupe records the new hashes only once their tracks are written
+    if (command == 'u' && strcmp(buf, "-") != 0) {
+        char tmpname[BUFSIZE + 8];
+        sprintf(tmpname, "%s.new", buf);
+        if (rename(tmpname, buf) != 0) {
+            perr("%s: %s: %s\n", prog_name, buf, strerror(errno));
+            remove(tmpname);
+            return EXIT_FAILURE;
+        }
+    }
 
-    return EXIT_SUCCESS;
+    return (nbad > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
-int gpsInfo( FILE *const outfile, const GpFile *filep ) {
+int gpsInfo( FILE *const outfile, const GpFileInfo *info ) {
 
-    _Bool sorted = true;
-    GpTrack *tp;
-    int n_tracks = getGpTracks(filep, &tp);
     char buf[BUFSIZE];
-    GpCoord NE = { -91, -181 };
-    GpCoord SW = { 91, 181 };
+    GpCoord NE = info->NEcorner;
+    GpCoord SW = info->SWcorner;
     char *p;
 
-    for (int i = 0; i < n_tracks; i++) {
-        NE.lat = MAX(tp[i].NEcorner.lat, NE.lat);
-        NE.lon = MAX(tp[i].NEcorner.lon, NE.lon);
-        SW.lat = MIN(tp[i].SWcorner.lat, SW.lat);
-        SW.lon = MIN(tp[i].SWcorner.lon, SW.lon);
-    }
-        
-    if (n_tracks > 0)
-        free(tp);
-
-    for (int i = 0; i < filep->nwaypts; i++) {
-        if (i > 0 && strcmp(filep->waypt[i].ID, filep->waypt[i-1].ID) < 0)
-            sorted = false;
-        NE.lat = MAX(filep->waypt[i].coord.lat, NE.lat);
-        NE.lon = MAX(filep->waypt[i].coord.lon, NE.lon);
-        SW.lat = MIN(filep->waypt[i].coord.lat, SW.lat);
-        SW.lon = MIN(filep->waypt[i].coord.lon, SW.lon);
-    }
-
     sprintf(buf, "Extent: SW %+lf %+lf to NE %+lf %+lf",
             SW.lon, SW.lat, NE.lon, NE.lat);
 
@@ -270,10 +508,11 @@ int gpsInfo( FILE *const outfile, const GpFile *filep ) {
 
     if (fprintf(outfile,
                 "%d waypoints%s\n%d routes\n%d trackpoints\n%d tracks\n%s\n",
-                filep->nwaypts,
-                (filep->nwaypts > 0) ?
-                    ((sorted == true) ? " (sorted)" : " (not sorted)") : "",
-                filep->nroutes, filep->ntrkpts, n_tracks, buf) < 0) {
+                info->nwaypts,
+                (info->nwaypts > 0) ?
+                    ((info->sorted == true) ? " (sorted)" : " (not sorted)")
+                    : "",
+                info->nroutes, info->ntrkpts, info->ntracks, buf) < 0) {
         disperr(WRITE);
         return EXIT_FAILURE;
     }
@@ -326,43 +565,49 @@ int gpsDiscard( GpFile *filep, const char *which ) {
 }
 
 
-int compGpWaypt(const void *wp1, const void  *wp2) {
+int gpsSort( GpFile *filep ) {
 
-    return strcmp(((GpWaypt*)wp1)->ID, ((GpWaypt*)wp2)->ID);
+    GpSortKey key = { 'i', { 0, 0 } };
+
+    if (sortGpWaypts(filep, &key, 1) == 0) {
+        disperr(SORT);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
 }
 
 
-int gpsSort( GpFile *filep ) {
+int gpsSortBy( GpFile *filep, const char *keys ) {
 
-    char **legIDs[filep->nroutes];
-    
-    for (int i = 0; i < filep->nroutes; i++) {
-        GpRoute *rp = *(filep->route + i);
-        legIDs[i] = malloc(rp->npoints * sizeof(char *));
-        assert(legIDs[i] != NULL);
-        for (int j = 0; j < rp->npoints; j++)
-            legIDs[i][j] = (filep->waypt + rp->leg[j])->ID;
-    }
-    qsort(filep->waypt, filep->nwaypts, sizeof(GpWaypt), compGpWaypt);
-    
-    for (int i = 0; i < filep->nroutes; i++) {
-        GpRoute *rp = *(filep->route + i);
-        for (int j = 0; j < rp->npoints; j++) {
-            for (int k = 0; k < filep->nwaypts; k++) {
-                if (strcmp(legIDs[i][j], filep->waypt[k].ID) == 0) {
-                    rp->leg[j] = k;
-                    break;
-                }
-            }
+    char buf[strlen(keys) + 1];
+    int nkeys = 0;
+    GpSortKey key[str_count_toks(keys, ",") + 1];
+
+    strcpy(buf, keys);
+    for (char *p = strtok(buf, ","); p != NULL; p = strtok(NULL, ",")) {
+        char c;
+        key[nkeys].field = p[0];
+        if ((p[0] == 'd' && sscanf(p + 1, "%lf:%lf%c", &key[nkeys].centre.lat,
+                                   &key[nkeys].centre.lon, &c) != 2)
+            || (p[0] != 'd' && p[1] != '\0')) {
+            disperr(ARGUMENT);
+            return EXIT_FAILURE;
         }
-        free(legIDs[i]);
+        nkeys++;
     }
 
+    if (sortGpWaypts(filep, key, nkeys) == 0) {
+        disperr(ARGUMENT);
+        return EXIT_FAILURE;
+    }
     return EXIT_SUCCESS;
 }
 
 
-int gpsMerge( GpFile *filep, const char *const fnameB ) {
+/*  Merge file fnameB into filep, appending its trackpoints or, byTime,
+    interleaving them with filep's by time  */
+static int mergeFile( GpFile *filep, const char *const fnameB,
+                      const _Bool byTime ) {
 
     FILE *fp = fopen(fnameB, "r");
     if (fp == NULL) {
@@ -515,13 +760,29 @@ int gpsMerge( GpFile *filep, const char *const fnameB ) {
                 filepB.trkpt[i].speed *= speed_fact;
             }
         }
-        // resize file A's trackpoint array and copy file B's to it's end
-        filep->trkpt = realloc(filep->trkpt, (filep->ntrkpts + filepB.ntrkpts) *
-                                              sizeof(GpTrkpt));
-        assert(filep->trkpt != NULL);
-        memcpy(filep->trkpt + filep->ntrkpts, filepB.trkpt,
-               filepB.ntrkpts * sizeof(GpTrkpt));
-        filep->ntrkpts += filepB.ntrkpts;
+        if (byTime == true) {
+            // merged tracks get distances etc. from the merged trackpoints
+            GpTrkpt *tp;
+            GpTrkptCheck check;
+            int n = mergeGpTrkpts(filep, &filepB, DUP_SECS,
+                                  DUP_KM * getGpUnitFactor(filep->unitHorz),
+                                  &tp);
+            freeGpTrkpts(filep);
+            freeGpTrkpts(&filepB);
+            filep->trkpt = tp;
+            filep->ntrkpts = n;
+            checkGpTrkpts(filep, 0, true, &check);
+        }
+        else {
+            // resize file A's trackpoint array and copy file B's to it's end
+            filep->trkpt = realloc(filep->trkpt,
+                                (filep->ntrkpts + filepB.ntrkpts) *
+                                sizeof(GpTrkpt));
+            assert(filep->trkpt != NULL);
+            memcpy(filep->trkpt + filep->ntrkpts, filepB.trkpt,
+                   filepB.ntrkpts * sizeof(GpTrkpt));
+            filep->ntrkpts += filepB.ntrkpts;
+        }
     }
 
     free(filepB.dateFormat);
@@ -531,3 +792,735 @@ int gpsMerge( GpFile *filep, const char *const fnameB ) {
     
     return EXIT_SUCCESS;
 }
+
+
+int gpsMerge( GpFile *filep, const char *const fnameB ) {
+
+    return mergeFile(filep, fnameB, false);
+}
+
+
+int gpsMergeTime( GpFile *filep, const char *const fnameB ) {
+
+    return mergeFile(filep, fnameB, true);
+}
+
+
+int gpsNear( FILE *const outfile, const GpFile *filep, const char *where ) {
+
+    char units[][8] = {
+        ['M'] = "m", ['K'] = "km", ['F'] = "ft", ['N'] = "nm", ['S'] = "miles"
+    };
+    double factor = getGpUnitFactor(filep->unitHorz);
+    GpCoord centre;
+    double dist;
+    GpIndex index;
+    GpMatch *mp;
+    char buf[BUFSIZE];
+    int n, rv = EXIT_SUCCESS;
+
+    if (sscanf(where, "%lf,%lf,%lf%1s", &centre.lat, &centre.lon, &dist, buf)
+            != 3 || fabs(centre.lat) > 90 || fabs(centre.lon) > 180
+        || dist < 0) {
+        disperr(ARGUMENT);
+        return EXIT_FAILURE;
+    }
+
+    buildGpIndex(filep, GP_CELLSIZE, &index);
+    n = queryGpRadius(&index, centre, dist / factor, &mp);
+    freeGpIndex(&index);
+
+    for (int i = 0; i < n && rv == EXIT_SUCCESS; i++) {
+        if (mp[i].isTrkpt == true) {
+            coordToStr(buf, filep->trkpt[mp[i].index].coord);
+            if (fprintf(outfile, "T %-8d %s %lf %s\n", mp[i].index + 1, buf,
+                        mp[i].dist * factor, units[(int)filep->unitHorz]) < 0)
+                rv = EXIT_FAILURE;
+        }
+        else {
+            coordToStr(buf, filep->waypt[mp[i].index].coord);
+            if (fprintf(outfile, "W %-8s %s %lf %s\n",
+                        filep->waypt[mp[i].index].ID, buf, mp[i].dist * factor,
+                        units[(int)filep->unitHorz]) < 0)
+                rv = EXIT_FAILURE;
+        }
+    }
+    free(mp);
+
+    if (rv == EXIT_FAILURE)
+        disperr(WRITE);
+    return rv;
+}
+
+
+int gpsSimplify( GpFile *filep, const char *tolerance ) {
+
+    char *p;
+    double tol = strtod(tolerance, &p);
+    _Bool *keep;
+    int n = 0, prev = 0;
+
+    if (p == tolerance || *p != '\0' || tol < 0) {
+        disperr(ARGUMENT);
+        return EXIT_FAILURE;
+    }
+
+    keep = malloc((filep->ntrkpts + 1) * sizeof(_Bool));
+    assert(keep != NULL);
+    simplifyGpTrkpts(filep, tol, keep);
+
+    // compact kept trackpoints, speed is now from the previous kept point
+    for (int i = 0; i < filep->ntrkpts; i++) {
+        GpTrkpt *tp = filep->trkpt + i;
+        if (keep[i] == false) {
+            free(tp->comment);
+            continue;
+        }
+        if (tp->segFlag == false && tp->duration > filep->trkpt[prev].duration)
+            tp->speed = (tp->dist - filep->trkpt[prev].dist)
+                        / (tp->duration - filep->trkpt[prev].duration)
+                        * ((filep->unitTime == 'H') ? 3600 : 1);
+        filep->trkpt[n] = *tp;
+        prev = n++;
+    }
+    free(keep);
+    filep->ntrkpts = n;
+    return EXIT_SUCCESS;
+}
+
+
+int gpsMapData( FILE *const outfile, const GpFile *filep, const char *which ) {
+
+    char buf[strlen(which) + 1];
+    int nitems = str_count_toks(which, ",");
+    int routes[nitems + 1], tracks[nitems + 1];
+    GpMapSpec spec = { false, false, 0, routes, 0, tracks, 0 };
+    int rv = EXIT_SUCCESS;
+
+    strcpy(buf, which);
+    for (char *p = strtok(buf, ","); p != NULL; p = strtok(NULL, ",")) {
+        char *end = p + 1;
+        long num = 0;
+
+        if (p[1] != '\0' && chrset(p[0], "rk") == true)
+            num = strtol(p + 1, &end, 10);
+        else if (p[1] != '\0' && p[0] == 'd')
+            spec.tolerance = strtod(p + 1, &end);
+
+        if (*end != '\0' || num < 0 || spec.tolerance < 0) {
+            disperr(ARGUMENT);
+            return EXIT_FAILURE;
+        }
+        else if (strcmp(p, "w") == 0) {
+            spec.waypts = true;
+        }
+        else if (strcmp(p, "t") == 0) {
+            spec.trkpts = true;
+        }
+        else if (strcmp(p, "r") == 0) {
+            spec.nroutes = -1;
+        }
+        else if (strcmp(p, "k") == 0) {
+            spec.ntracks = -1;
+        }
+        else if (p[0] == 'r') {
+            if (spec.nroutes != -1)
+                routes[spec.nroutes++] = (int)num;
+        }
+        else if (p[0] == 'k') {
+            if (spec.ntracks != -1)
+                tracks[spec.ntracks++] = (int)num;
+        }
+        else if (p[0] != 'd') {
+            disperr(COMPONENT);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (writeGpMapData(outfile, filep, &spec) == 0) {
+        disperr(WRITE);
+        rv = EXIT_FAILURE;
+    }
+    return rv;
+}
+
+
+/*  Create directory path if it doesn't already exist  */
+static int makeDir( const char *path ) {
+
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+
+int gpsTiles( FILE *const outfile, const GpFile *filep, const char *which ) {
+
+    char dir[strlen(which) + 1];
+    char path[strlen(which) + 64];
+    char *sel;
+    int nitems = str_count_toks(which, ",");
+    int tracks[nitems + 1], ntracks = -1;
+    _Bool *keep = malloc((filep->ntrkpts + 1) * sizeof(_Bool));
+    _Bool *chosen = malloc((filep->ntrkpts + 1) * sizeof(_Bool));
+    double factor = getGpUnitFactor(filep->unitHorz);
+    GpCoord sw = { 90, 180 }, ne = { -90, -180 };
+    int total = 0;
+    FILE *fp;
+
+    assert(keep != NULL && chosen != NULL);
+    // DIR,SELECTION: only the tracks selected as for -map
+    strcpy(dir, which);
+    if ( (sel = strchr(dir, ',')) != NULL) {
+        *sel++ = '\0';
+        ntracks = 0;
+        for (char *p = strtok(sel, ","); p != NULL; p = strtok(NULL, ",")) {
+            char *end;
+            long num = 0;
+
+            if (strcmp(p, "k") == 0 || strcmp(p, "t") == 0) {
+                ntracks = -1;
+                continue;
+            }
+            if (p[0] == 'k' && p[1] != '\0')
+                num = strtol(p + 1, &end, 10);
+            if (p[0] != 'k' || p[1] == '\0' || *end != '\0' || num < 0) {
+                disperr(COMPONENT);
+                free(keep);
+                free(chosen);
+                return EXIT_FAILURE;
+            }
+            if (ntracks != -1)
+                tracks[ntracks++] = (int)num;
+        }
+    }
+    for (int i = 0, seqno = 0; i < filep->ntrkpts; i++) {
+        if (i == 0 || filep->trkpt[i].segFlag == true) {
+            seqno = i + 1;
+            chosen[i] = (ntracks == -1);
+            for (int j = 0; j < ntracks && chosen[i] == false; j++)
+                chosen[i] = (tracks[j] == seqno);
+        }
+        else {
+            chosen[i] = chosen[i-1];
+        }
+    }
+
+    if (makeDir(dir) == false) {
+        perr("%s: %s: %s\n", prog_name, dir, strerror(errno));
+        free(keep);
+        free(chosen);
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < filep->ntrkpts; i++) {
+        GpCoord c = filep->trkpt[i].coord;
+        if (chosen[i] == false)
+            continue;
+        sw.lat = MIN(sw.lat, c.lat);
+        sw.lon = MIN(sw.lon, c.lon);
+        ne.lat = MAX(ne.lat, c.lat);
+        ne.lon = MAX(ne.lon, c.lon);
+    }
+
+    for (int zoom = 0; zoom <= GP_MAXZOOM; zoom++) {
+        // drop detail finer than a pixel at the track's mid latitude
+        double pixel = 2 * M_PI * GP_EARTH_RADIUS
+                       * cos((sw.lat + ne.lat) / 2 * M_PI / 180) / (256 << zoom);
+        GpTile *tiles;
+        int ntiles;
+
+        simplifyGpTrkpts(filep, pixel * factor, keep);
+        for (int i = 0; i < filep->ntrkpts; i++)
+            keep[i] = keep[i] && chosen[i];
+        ntiles = getGpTiles(filep, zoom, keep, &tiles);
+        for (int i = 0; i < ntiles; i++) {
+            int ok;
+            sprintf(path, "%s/%d", dir, zoom);
+            ok = makeDir(path);
+            sprintf(path, "%s/%d/%ld", dir, zoom, tiles[i].x);
+            ok = ok && makeDir(path);
+            sprintf(path, "%s/%d/%ld/%ld.json", dir, zoom, tiles[i].x,
+                    tiles[i].y);
+            if (ok == false || (fp = fopen(path, "w")) == NULL) {
+                perr("%s: %s: %s\n", prog_name, path, strerror(errno));
+                freeGpTiles(tiles, ntiles);
+                free(keep);
+                free(chosen);
+                return EXIT_FAILURE;
+            }
+            ok = writeGpTile(fp, filep, tiles + i);
+            if (fclose(fp) != 0 || ok == false) {
+                disperr(WRITE);
+                freeGpTiles(tiles, ntiles);
+                free(keep);
+                free(chosen);
+                return EXIT_FAILURE;
+            }
+        }
+        freeGpTiles(tiles, ntiles);
+        total += ntiles;
+    }
+    free(keep);
+    free(chosen);
+
+    // extent of the pyramid, for the viewer's initial position
+    sprintf(path, "%s/tiles.json", dir);
+    if ((fp = fopen(path, "w")) == NULL) {
+        perr("%s: %s: %s\n", prog_name, path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    fprintf(fp, "{\"maxzoom\": %d, \"sw\": [%.6f, %.6f],"
+            " \"ne\": [%.6f, %.6f], \"ntiles\": %d}\n",
+            GP_MAXZOOM, sw.lat, sw.lon, ne.lat, ne.lon, total);
+    if (fclose(fp) != 0) {
+        disperr(WRITE);
+        return EXIT_FAILURE;
+    }
+    fprintf(outfile, "%d tiles written to %s\n", total, dir);
+    return EXIT_SUCCESS;
+}
+
+
+int gpsColumnar( FILE *const outfile, const GpFile *filep,
+                 const char *fname ) {
+
+    FILE *fp = fopen(fname, "wb");
+    int ok;
+
+    if (fp == NULL) {
+        perr("%s: %s: %s\n", prog_name, fname, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    ok = writeGpColumns(fp, filep);
+    if (fclose(fp) != 0 || ok == false) {
+        disperr(WRITE);
+        return EXIT_FAILURE;
+    }
+    fprintf(outfile, "%d trackpoints in %d chunks written to %s\n",
+            filep->ntrkpts, (filep->ntrkpts + GP_COLCHUNK - 1) / GP_COLCHUNK,
+            fname);
+    return EXIT_SUCCESS;
+}
+
+
+typedef struct {    // a track's content hash, see gpsDedupe()
+    uint64_t hash;
+    int track;          // subscript in the order of getGpTracks()
+} TrackHash;
+
+static int compTrackHash( const void *a, const void *b ) {
+
+    const TrackHash *x = a, *y = b;
+
+    if (x->hash != y->hash)
+        return (x->hash < y->hash) ? -1 : 1;
+    return x->track - y->track;
+}
+
+static int compHash( const void *a, const void *b ) {
+
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+/*  Read a hash file: HASHMAGIC, then ascending native-order 64-bit hashes.
+    A missing file is an empty set.  Returns: no. of hashes, or -1 on error  */
+static long readHashFile( const char *fname, uint64_t **set ) {
+
+    char magic[sizeof(HASHMAGIC)] = "";
+    struct stat st;
+    FILE *fp = fopen(fname, "rb");
+    size_t n;
+
+    *set = NULL;
+    if (fp == NULL)
+        return (errno == ENOENT) ? 0 : -1;
+    if (fstat(fileno(fp), &st) != 0
+        || fread(magic, 1, HASHMAGICLEN, fp) != HASHMAGICLEN
+        || strcmp(magic, HASHMAGIC) != 0
+        || (st.st_size - HASHMAGICLEN) % sizeof(uint64_t) != 0) {
+        fclose(fp);
+        errno = EINVAL;
+        return -1;
+    }
+    n = (st.st_size - HASHMAGICLEN) / sizeof(uint64_t);
+    *set = malloc((n + 1) * sizeof(uint64_t));
+    assert(*set != NULL);
+    if (fread(*set, sizeof(uint64_t), n, fp) != n) {
+        fclose(fp);
+        free(*set);
+        *set = NULL;
+        errno = EIO;
+        return -1;
+    }
+    fclose(fp);
+    return (long)n;
+}
+
+
+/*  Drop the tracks whose content hash is in the hash file fname, or that
+    repeat a track earlier in the input, and write the hash file with the
+    remaining tracks' hashes added to fname.new, for main() to rename over
+    fname once the output is written.  A fname of "-" dedupes the input
+    alone, without a hash file.  */
+int gpsDedupe( GpFile *filep, const char *fname ) {
+
+    _Bool persist = strcmp(fname, "-") != 0;
+    uint64_t *hash, *old = NULL;
+    long nold = 0;
+    int ntracks = getGpTrackHashes(filep, &hash);
+    int ndropped = 0, nnew = 0;
+
+    if (persist == true && (nold = readHashFile(fname, &old)) < 0) {
+        perr("%s: %s: %s\n", prog_name, fname, strerror(errno));
+        free(hash);
+        return EXIT_FAILURE;
+    }
+
+    // sorted by hash, the first of equal hashes is the input's earliest
+    TrackHash *order = malloc((ntracks + 1) * sizeof(TrackHash));
+    _Bool *dup = calloc(ntracks + 1, sizeof(_Bool));
+    uint64_t *fresh = malloc((ntracks + 1) * sizeof(uint64_t));
+    assert(order != NULL && dup != NULL && fresh != NULL);
+    for (int t = 0; t < ntracks; t++) {
+        order[t].hash = hash[t];
+        order[t].track = t;
+    }
+    qsort(order, ntracks, sizeof(TrackHash), compTrackHash);
+    for (int i = 0; i < ntracks; i++) {
+        if (i > 0 && order[i].hash == order[i-1].hash)
+            dup[order[i].track] = true;
+        else if (nold > 0 && bsearch(&order[i].hash, old, nold,
+                                     sizeof(uint64_t), compHash) != NULL)
+            dup[order[i].track] = true;
+        else
+            fresh[nnew++] = order[i].hash;
+        ndropped += dup[order[i].track];
+    }
+    free(order);
+    free(hash);
+
+    if (ndropped > 0) {
+        _Bool *keep = malloc((filep->ntrkpts + 1) * sizeof(_Bool));
+        assert(keep != NULL);
+        for (int i = 0, t = -1; i < filep->ntrkpts; i++) {
+            if (i == 0 || filep->trkpt[i].segFlag == true)
+                t++;
+            keep[i] = !dup[t];
+        }
+        keepGpTrkpts(filep, keep);
+        free(keep);
+    }
+    free(dup);
+
+    int ok = true;
+    if (persist == true) {
+        char tmpname[BUFSIZE + 8];
+        FILE *fp;
+
+        sprintf(tmpname, "%s.new", fname);
+        if ( (fp = fopen(tmpname, "wb")) == NULL)
+            ok = false;
+        else {
+            // merge the new hashes into the old, keeping them ascending
+            long i = 0, j = 0;
+            ok = fwrite(HASHMAGIC, 1, HASHMAGICLEN, fp) == HASHMAGICLEN;
+            while (ok == true && (i < nold || j < nnew)) {
+                uint64_t *next = (j == nnew || (i < nold && old[i] < fresh[j]))
+                                 ? old + i++ : fresh + j++;
+                ok = fwrite(next, sizeof(uint64_t), 1, fp) == 1;
+            }
+            if (fclose(fp) != 0)
+                ok = false;
+            if (ok == false)
+                remove(tmpname);
+        }
+        if (ok == false)
+            perr("%s: %s: %s\n", prog_name, tmpname, strerror(errno));
+    }
+    free(old);
+    free(fresh);
+    if (ok == false)
+        return EXIT_FAILURE;
+
+    perr("%s: %d of %d tracks dropped as duplicates\n", prog_name, ndropped,
+         ntracks);
+    return EXIT_SUCCESS;
+}
+
+
+int gpsFilter( GpFile *filep, const char *filter ) {
+
+    GpTrkptFilter spec;
+    _Bool *keep;
+
+    if (parseGpTrkptFilter(filter, &spec) == 0) {
+        disperr(ARGUMENT);
+        return EXIT_FAILURE;
+    }
+
+    keep = malloc((filep->ntrkpts + 1) * sizeof(_Bool));
+    assert(keep != NULL);
+    selectGpTrkpts(filep, &spec, keep);
+    keepGpTrkpts(filep, keep);
+    free(keep);
+
+    if (filep->nwaypts == 0 && filep->nroutes == 0 && filep->ntrkpts == 0) {
+        disperr(EMPTYFILE);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+int gpsResample( GpFile *filep, const char *step ) {
+
+    char *p;
+    double value = strtod(step + 1, &p);
+    GpTrkpt *tp;
+    int n;
+
+    if (p == step + 1 || *p != '\0'
+        || (n = resampleGpTrkpts(filep, step[0], value, &tp)) < 0) {
+        disperr(ARGUMENT);
+        return EXIT_FAILURE;
+    }
+    freeGpTrkpts(filep);
+    filep->trkpt = tp;
+    filep->ntrkpts = n;
+    return EXIT_SUCCESS;
+}
+
+
+int gpsRecompute( FILE *const outfile, GpFile *filep, const char *how ) {
+
+    char units[][8] = {
+        ['M'] = "m", ['K'] = "km", ['F'] = "ft", ['N'] = "nm", ['S'] = "miles"
+    };
+    char *p;
+    double tol = (how[0] != '\0' && how[1] != '\0') ? strtod(how + 1, &p)
+                                                     : 0.01;
+    GpTrkptCheck check;
+    const char *unit = units[(int)filep->unitHorz];
+    const char *time = (filep->unitTime == 'H') ? "h" : "s";
+
+    if (chrset(how[0], "rw") == false || (how[1] != '\0' && *p != '\0')
+        || tol < 0) {
+        disperr(ARGUMENT);
+        return EXIT_FAILURE;
+    }
+
+    checkGpTrkpts(filep, tol, how[0] == 'w', &check);
+    if (how[0] == 'w')
+        return EXIT_SUCCESS;
+
+    if (fprintf(outfile, "%d trackpoints, %d off", filep->ntrkpts,
+                check.npoints) < 0
+        || (check.first != -1
+            && fprintf(outfile, " (first is trackpoint %d)",
+                       check.first + 1) < 0)
+        || fprintf(outfile, "\ndistance: %d off, max. error %lf %s\n"
+                   "speed:    %d off, max. error %lf %s/%s\n"
+                   "duration: %d off, max. error %ld sec.\n",
+                   check.ndist, check.maxDist, unit,
+                   check.nspeed, check.maxSpeed, unit, time,
+                   check.nduration, check.maxDuration) < 0) {
+        disperr(WRITE);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+int gpsSegment( GpFile *filep, const char *split ) {
+
+    char buf[strlen(split) + 1];
+    GpSplitSpec spec = { 0, 0, 0, 0 };
+
+    strcpy(buf, split);
+    for (char *p = strtok(buf, ","); p != NULL; p = strtok(NULL, ",")) {
+        char c;
+        int n = 0;
+        if (p[0] == 'g')
+            n = sscanf(p + 1, "%ld%c", &spec.maxGap, &c);
+        else if (p[0] == 's')
+            n = sscanf(p + 1, "%ld:%lf%c", &spec.minStop, &spec.stopRadius,
+                       &c) - 1;
+        else if (p[0] == 'j')
+            n = sscanf(p + 1, "%lf%c", &spec.maxJump, &c);
+
+        if (n != 1 || spec.maxGap < 0 || spec.minStop < 0
+            || spec.stopRadius < 0 || spec.maxJump < 0) {
+            disperr(ARGUMENT);
+            return EXIT_FAILURE;
+        }
+    }
+
+    splitGpTracks(filep, &spec);
+    return EXIT_SUCCESS;
+}
+
+
+/*  Write seconds as hh:mm:ss into buf  */
+static char *hms( char *buf, long sec ) {
+
+    sprintf(buf, "%02ld:%02ld:%02ld", sec / 3600, sec / 60 % 60, sec % 60);
+    return buf;
+}
+
+
+int gpsStats( FILE *const outfile, const GpFile *filep ) {
+
+    char speed_units[][8] = {
+        ['M'] = "m/s", ['K'] = "km/h", ['F'] = "ft/s", ['N'] = "knots",
+        ['S'] = "mph"
+    };
+    const char *unit = speed_units[(int)filep->unitHorz];
+    // stopped below 1 km/h, in the file's speed units
+    float stopSpeed = getGpUnitFactor(filep->unitHorz)
+                      / ((filep->unitTime == 'H') ? 1 : 3600);
+    GpTrackStats *sp;
+    int n = getGpTrackStats(filep, stopSpeed, 95, &sp);
+    int rv = EXIT_SUCCESS;
+
+    if (fprintf(outfile, "H    Track    Pnts. Moving   Stopped  "
+                "%10s %10s %10s    Climb  Descent   MinAlt   MaxAlt\n",
+                "Avg.", "Max.", "95%") < 0
+        || fprintf(outfile, "H %35s %10s %10s %10s\n", "", unit, unit,
+                   unit) < 0)
+        rv = EXIT_FAILURE;
+
+    for (int i = 0; i < n && rv == EXIT_SUCCESS; i++) {
+        char moving[16], stopped[16], minAlt[16] = "-", maxAlt[16] = "-";
+        if (isnan(sp[i].minAlt) == false) {
+            sprintf(minAlt, "%.1f", sp[i].minAlt);
+            sprintf(maxAlt, "%.1f", sp[i].maxAlt);
+        }
+        if (fprintf(outfile, "H %8d %8d %s %s %10.3f %10.3f %10.3f %8.1f"
+                    " %8.1f %8s %8s\n", sp[i].seqno, sp[i].npoints,
+                    hms(moving, sp[i].movingTime),
+                    hms(stopped, sp[i].stoppedTime), sp[i].movingSpeed,
+                    sp[i].maxSpeed, sp[i].pctSpeed, sp[i].climb,
+                    sp[i].descent, minAlt, maxAlt) < 0)
+            rv = EXIT_FAILURE;
+    }
+    free(sp);
+
+    if (rv == EXIT_FAILURE)
+        disperr(WRITE);
+    return rv;
+}
+
+
+/*  Write the summary line of track i as in a file's track header  */
+static int writeTrackLine( FILE *const outfile, const GpFile *filep,
+                           const GpReader *reader, int i ) {
+
+    const GpTrack *tp = reader->track + i;
+    int npts = (i < reader->ntracks - 1) ? tp[1].seqno - tp->seqno - 1
+                                         : filep->ntrkpts - tp->seqno;
+    char start[BUFSIZE], end[BUFSIZE], duration[16];
+    struct tm timebuf;
+
+    if (localtime_r(&tp->startTrk, &timebuf) == NULL
+        || strftime(start, BUFSIZE - 10, filep->dateFormat, &timebuf) == 0
+        || strftime(start + strlen(start), 10, " %X", &timebuf) == 0
+        || localtime_r(&tp->endTrk, &timebuf) == NULL
+        || strftime(end, BUFSIZE, "%X", &timebuf) == 0)
+        return EXIT_FAILURE;
+
+    if (fprintf(outfile, "H %8d %8d %s %s %s %lf %f\n", tp->seqno, npts,
+                start, end, hms(duration, tp->duration), tp->dist,
+                tp->speed) < 0)
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+
+int gpsFollow( FILE *const outfile, const char *fname ) {
+
+    char dist_units[][8] = {
+        ['M'] = "m", ['K'] = "km", ['F'] = "ft", ['N'] = "nm", ['S'] = "miles"
+    };
+    char speed_units[][8] = {
+        ['M'] = "m/s", ['K'] = "km/h", ['F'] = "ft/s", ['N'] = "knots",
+        ['S'] = "mph"
+    };
+    FILE *fp = fopen(fname, "r");
+    GpFile file;
+    GpReader reader;
+    char units = 0;
+    int rv = EXIT_SUCCESS;
+
+    if (fp == NULL) {
+        perr("%s: %s: %s\n", prog_name, fname, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    initGpReader(&reader, &file);
+
+    while (rv == EXIT_SUCCESS) {
+        int ntracks = reader.ntracks;
+        int ntrkpts = file.ntrkpts;
+        struct stat st, path;
+        _Bool replaced;
+        GpStatus status;
+
+        // start over if the file was replaced, as by a logger rotating it
+        // (renamed or re-created), or truncated
+        replaced = stat(fname, &path) == 0 && fstat(fileno(fp), &st) == 0
+                   && (path.st_ino != st.st_ino || path.st_dev != st.st_dev);
+        if (replaced == true) {
+            FILE *newfp = fopen(fname, "r");
+            if (newfp != NULL) {
+                fclose(fp);
+                fp = newfp;
+            }
+            else {
+                replaced = false;
+            }
+        }
+        if (replaced == true
+            || (fstat(fileno(fp), &st) == 0 && st.st_size < reader.offset)) {
+            freeGpFile(&file);
+            freeGpReader(&reader);
+            initGpReader(&reader, &file);
+            ntracks = ntrkpts = 0;
+        }
+
+        status = resumeGpFile(fp, &reader, &file);
+        if (status.code != OK) {
+            perr("Input error: line %d: %s\n", status.lineno,
+                 codes[status.code]);
+            rv = EXIT_FAILURE;
+        }
+
+        // column headings again if the units changed
+        if (reader.ntracks > 0 && file.unitHorz != units) {
+            units = file.unitHorz;
+            if (fprintf(outfile, "H    Track    Pnts. Date     Time     "
+                        "StopTime Duration %s %s\n",
+                        dist_units[(int)units], speed_units[(int)units]) < 0)
+                rv = EXIT_FAILURE;
+        }
+
+        // the tracks given new trackpoints
+        if (ntracks > 0 && file.ntrkpts > ntrkpts
+            && file.trkpt[ntrkpts].segFlag == false)
+            ntracks--;
+        for (int i = ntracks; i < reader.ntracks && rv == EXIT_SUCCESS; i++) {
+            if (writeTrackLine(outfile, &file, &reader, i) == EXIT_FAILURE) {
+                disperr(WRITE);
+                rv = EXIT_FAILURE;
+            }
+        }
+
+        fflush(outfile);
+        if (rv == EXIT_SUCCESS)
+            sleep(FOLLOW_SECS);
+    }
+
+    freeGpFile(&file);
+    freeGpReader(&reader);
+    fclose(fp);
+    return rv;
+}
@@ -26,9 +26,24 @@ static char codes[][48] = {
     "unknown waypoint ID"                           // UNKWPT
 };
 
-int gpsInfo( FILE *const outfile, const GpFile *filep );
+int gpsInfo( FILE *const outfile, const GpFileInfo *info );
 int gpsDiscard( GpFile *filep, const char *which );
 int gpsSort( GpFile *filep );
+int gpsSortBy( GpFile *filep, const char *keys );
 int gpsMerge( GpFile *filep, const char *const fnameB );
+int gpsMergeTime( GpFile *filep, const char *const fnameB );
+int gpsNear( FILE *const outfile, const GpFile *filep, const char *where );
+int gpsSimplify( GpFile *filep, const char *tolerance );
+int gpsMapData( FILE *const outfile, const GpFile *filep, const char *which );
+int gpsTiles( FILE *const outfile, const GpFile *filep, const char *which );
+int gpsColumnar( FILE *const outfile, const GpFile *filep,
+    const char *fname );
+int gpsDedupe( GpFile *filep, const char *fname );
+int gpsFilter( GpFile *filep, const char *filter );
+int gpsResample( GpFile *filep, const char *step );
+int gpsRecompute( FILE *const outfile, GpFile *filep, const char *how );
+int gpsSegment( GpFile *filep, const char *split );
+int gpsStats( FILE *const outfile, const GpFile *filep );
+int gpsFollow( FILE *const outfile, const char *fname );
 
 #endif
@@ -8,14 +8,19 @@ ID #0523365
 #ifndef _XOPEN_SOURCE
 #define _XOPEN_SOURCE 500
 #endif
+#define _GNU_SOURCE     // fopencookie
 
-#define BUFSIZE 1024
+#define BUFSIZE GP_MAXLINE
+#define ZBUFSIZE (256 * 1024)   // compressed bytes read or written at a time
 #define MAX_FIELD_LENGTH 64
 #define SPACE " \t"
+#define MIN(a, b) (a < b ? a : b)
+#define MAX(a, b) (a > b ? a : b)
 #define COUNT count
 #define LATLEN (int)strlen("N00.000000")
 #define LONLEN (int)strlen("W000.000000")
 #define TIMELEN strlen("hh:mm:ss")
+#define RAD(deg) ((deg) * M_PI / 180)
 
 #ifdef NDEBUG
 #define PDEB fprintf(stderr, "%s:%s:%d\n",__FILE__, __func__, __LINE__);
@@ -34,6 +39,35 @@ ID #0523365
 #include <stdarg.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <zlib.h>
+#include <limits.h>
+
+#ifdef GP_PROFILE
+static GpProfile gpProfile;   // read only through getGpProfile()
+
+/*  Monotonic clock in nanoseconds, for the profiling counters  */
+static long long profNow( void ) {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#define PROF_START(t) long long t = profNow()
+#define PROF_STOP(phase, t) { gpProfile.ns[phase] += profNow() - t; \
+                              gpProfile.calls[phase]++; }
+#define PROF_ALLOC(bytes) { gpProfile.nallocs++; \
+                            gpProfile.allocBytes += (bytes); }
+#else
+#define PROF_START(t)
+#define PROF_STOP(phase, t) ;
+#define PROF_ALLOC(bytes) ;
+#endif
+
+// time the statement(s) in phase
+#define PROF(phase, ...) { PROF_START(t_); __VA_ARGS__; PROF_STOP(phase, t_); }
 
 /*  All the possible F line column types    */
 typedef enum {
@@ -248,763 +282,4413 @@ GpError parseGpCoords(char *lat, char *lon, GpCoord *coord) {
 }
 
 
-GpStatus readGpFile( FILE *const gpf, GpFile *filep ) { 
-   
-    char buf[BUFSIZE];
-    char fieldDef[BUFSIZE] = "";
-    _Bool isRoute = false;    
-    GpStatus status;
-
-    GpFile f = {
-        newstr(GP_DATEFORMAT), GP_TIMEZONE, GP_UNITHORZ, GP_UNITTIME, 0, NULL, 
-        0, NULL, 0, NULL
-    };
-    *filep = f;
-    
-    for (status.lineno = 1, status.code = OK; feof(gpf) == 0; status.lineno++) {
-        char code;
-        memset(buf,'\0',BUFSIZE);
-        if (fgets(buf, BUFSIZE, gpf) == NULL)
-            break;
+/*  Store the setting on an 'S' line in filep: DateFormat, TimeZone or Units,
+    others being ignored.  buf is tokenized.
+    Returns:    VALUE for a setting it can't use, else OK  */
+static GpError scanGpSetting( char *buf, GpFile *filep ) {
 
-        // validate first 2 bytes
-        code = buf[0];        
-        if (chrset(code, "CAH\n\r") == true) {
-            continue;
+    char *setting = strtok((buf + 1), " \t=");
+    // DateFormat setting
+    if (strcmp_ic(setting, "DateFormat") == 0) {
+        char code[3];
+        for (int j = 0; j < 3; j++) {
+            char *p = strtok(NULL, "/");
+            if (p == NULL) {
+                return VALUE;
+            }
+            if (strcmp(p, "dd") == 0) {
+                code[j] = 'd';
+            }
+            else if (strcmp(p, "mm") == 0) {
+                code[j] = 'm';
+            }
+            else if (strcmp(p, "mmm") == 0) {
+                code[j] = 'b';
+            }
+            else if (strcmp(p, "yy") == 0) {
+                code[j] = 'y';
+            }
+            else if (strcmp(p, "yyyy") == 0) {
+                code[j] = 'Y';
+            }
+            else {
+                return VALUE;
+            }
         }
-        else if (chrset(code, "ISMUFWRT") == false) {
-            status.code = UNKREC;
-            break;
+        sprintf(filep->dateFormat, "%%%c/%%%c/%%%c", code[0], code[1],
+                code[2]);
+    }
+    // TimeZone setting
+    else if (strcmp_ic(setting, "TimeZone") == 0) {
+        int m;
+        if (sscanf(strtok(NULL, ""), "%d:%d", &(filep->timeZone), &m)
+            != 2) {
+            return VALUE;
         }
-        else if (buf[1] != ' ') {
-            status.code = BADSEP;
-            break;
+    }
+    // Units setting
+    else if (strcmp_ic(setting, "Units") == 0) {
+        if (sscanf(strtok(NULL, ""), "%[MKFNS]",
+            &(filep->unitHorz)) != 1) {
+            return VALUE;
         }
+        if (chrset(filep->unitHorz, "FM") == true)
+            filep->unitTime = 'S';
+        else if (chrset(filep->unitHorz, "KNS") == true)
+            filep->unitTime = 'H';
+    }
+    return OK;
+}
 
-        // remove EOL character
-        if (strpbrk(buf, "\n\r") != NULL)
-            *strpbrk(buf, "\n\r") = '\0';
 
-        // check if we are continuing to scan a route
-        if ( (isRoute == true) && (chrset(code, "FW") == false) )
-            isRoute = false;
+/*  Scan one line of a GPSU file into filep, in the context of the lines before
+    it held by reader.
+    Paramaters: buf is the line, which may be changed
+    Returns:    the error in the line, or OK  */
+static GpError scanGpRecord( char *buf, GpReader *reader, GpFile *filep ) {
 
-        // 'I' line must start w/ "GPSU"
-        if ( (code == 'I') && (strcmp_ic(strtok(buf+1, SPACE), "GPSU") != 0) ) {
-            status.code = FILTYP;
-            break;
-        }
-        // 'M' line must contain WGS 84
-        else if ( (code == 'M') && (strstr_ic(buf, "WGS 84") == NULL) ) {
-            status.code = DATUM;
-            break;
+    char code;
+    GpError err = OK;
+
+    // validate first 2 bytes
+    code = buf[0];        
+    if (chrset(code, "CAH\n\r") == true) {
+        return OK;
+    }
+    else if (chrset(code, "ISMUFWRT") == false) {
+        return UNKREC;
+    }
+    else if (buf[1] != ' ') {
+        return BADSEP;
+    }
+
+    // remove EOL character
+    if (strpbrk(buf, "\n\r") != NULL)
+        *strpbrk(buf, "\n\r") = '\0';
+
+    // check if we are continuing to scan a route
+    if ( (reader->isRoute == true) && (chrset(code, "FW") == false) ) {
+        reader->isRoute = false;
+        reader->badRoute = false;
+    }
+
+    // 'I' line must start w/ "GPSU"
+    if ( (code == 'I') && (strcmp_ic(strtok(buf+1, SPACE), "GPSU") != 0) ) {
+        return FILTYP;
+    }
+    // 'M' line must contain WGS 84
+    else if ( (code == 'M') && (strstr_ic(buf, "WGS 84") == NULL) ) {
+        return DATUM;
+    }
+    // 'U' line must contain "LAT LON DEG"
+    else if ( (code == 'U') && (strstr_ic(buf, "LAT LON DEG") == NULL) ) {
+        return COORD;
+    }        
+    // 'F' line defines new field header
+    else if (code == 'F') {
+        strcpy(reader->fieldDef, buf);
+    }
+    // 'S' line stores a setting
+    else if (code == 'S') {
+        return scanGpSetting(buf, filep);
+    }
+    // 'W', 'R', 'T' lines require previous field declaration 
+    else if ( (chrset(code, "WT") == true)
+             && (strlen(reader->fieldDef) == 0) ) {
+        return NOFORM;
+    }
+    // 'W' line is route leg
+    else if ( (code == 'W') && (reader->isRoute == true) ) {
+        if (reader->badRoute == true)
+            return OK;      // leg of a route in error, already reported
+        int n_legs = ++(*(filep->route + filep->nroutes - 1))->npoints;
+        GpRoute *rp;
+        PROF(GP_PROF_ALLOC,
+             rp = realloc( *(filep->route + filep->nroutes - 1),
+                           sizeof(GpRoute) + (n_legs * sizeof(int)) ));
+        PROF_ALLOC(sizeof(GpRoute) + (n_legs * sizeof(int)));
+        assert(rp != NULL);
+        *(filep->route + filep->nroutes - 1) = rp;
+
+        err = scanGpLeg(buf, reader->fieldDef, filep->waypt, filep->nwaypts,
+                        *(filep->route + filep->nroutes - 1));
+        if (err != OK) {
+            rp->npoints--;
+            return err;
         }
-        // 'U' line must contain "LAT LON DEG"
-        else if ( (code == 'U') && (strstr_ic(buf, "LAT LON DEG") == NULL) ) {
-            status.code = COORD;
-            break;
-        }        
-        // 'F' line defines new field header
-        else if (code == 'F') {
-            strcpy(fieldDef, buf);
+    }
+    // 'W' line is waypoint
+    else if ( (code == 'W') && (reader->isRoute == false) ) {
+        PROF(GP_PROF_ALLOC,
+             filep->waypt = realloc(filep->waypt,
+                               (filep->nwaypts + 1)*sizeof(GpWaypt)));
+        PROF_ALLOC((filep->nwaypts + 1)*sizeof(GpWaypt));
+        assert(filep->waypt != NULL);
+        err = scanGpWaypt(buf, reader->fieldDef, filep->waypt + filep->nwaypts);
+        if (err != OK)
+            return err;
+        filep->nwaypts++;
+    }
+    // 'R' line starts new route
+    else if (code == 'R') {
+        PROF(GP_PROF_ALLOC,
+             filep->route = realloc(filep->route,
+                               (filep->nroutes + 1)*sizeof(GpRoute *)));
+        PROF_ALLOC((filep->nroutes + 1)*sizeof(GpRoute *));
+        assert(filep->route != NULL);
+        PROF(GP_PROF_ALLOC,
+             *(filep->route + filep->nroutes) = malloc(sizeof(GpRoute)));
+        PROF_ALLOC(sizeof(GpRoute));
+        assert(*(filep->route + filep->nroutes) != NULL);
+        // a route in error is dropped along with its legs
+        reader->isRoute = true;
+        reader->badRoute = true;
+        err = scanGpRoute(buf, *(filep->route + filep->nroutes));
+        if (err != OK) {
+            free(*(filep->route + filep->nroutes));
+            return err;
         }
-        // 'S' line stores a setting
-        else if (code == 'S') {
-            char *setting = strtok((buf + 1), " \t=");
-            // DateFormat setting
-            if (strcmp_ic(setting, "DateFormat") == 0) {
-                char code[3];
-                for (int j = 0; j < 3; j++) {
-                    char *p = strtok(NULL, "/");
-                    if (p == NULL) {
-                        freeGpFile(filep);
-                        status.code = VALUE;
-                        return status;
-                    }
-                    if (strcmp(p, "dd") == 0) {
-                        code[j] = 'd';
-                    }
-                    else if (strcmp(p, "mm") == 0) {
-                        code[j] = 'm';
-                    }
-                    else if (strcmp(p, "mmm") == 0) {
-                        code[j] = 'b';
-                    }
-                    else if (strcmp(p, "yy") == 0) {
-                        code[j] = 'y';
-                    }
-                    else if (strcmp(p, "yyyy") == 0) {
-                        code[j] = 'Y';
-                    }
-                    else {
-                        freeGpFile(filep);
-                        status.code = VALUE;
-                        return status;
-                    }
-                }
-                sprintf(filep->dateFormat, "%%%c/%%%c/%%%c", code[0], code[1],
-                        code[2]);
-            }
-            // TimeZone setting
-            else if (strcmp_ic(setting, "TimeZone") == 0) {
-                int m;
-                if (sscanf(strtok(NULL, ""), "%d:%d", &(filep->timeZone), &m)
-                    != 2) {
-                    status.code = VALUE;
-                    break;
-                }
+        filep->nroutes++;
+        // check for duplicate routes
+        for (int i = 0; i < (filep->nroutes - 1); i++) {
+            if ( (*(filep->route + i))->number == (*(filep->route
+                    + filep->nroutes - 1))->number ) {
+                filep->nroutes--;
+                free((*(filep->route + filep->nroutes))->comment);
+                free(*(filep->route + filep->nroutes));
+                return DUPRT;
             }
-            // Units setting
-            else if (strcmp_ic(setting, "Units") == 0) {
-                if (sscanf(strtok(NULL, ""), "%[MKFNS]",
-                    &(filep->unitHorz)) != 1) {
-                    status.code = VALUE;
-                    break;
-                }
-                if (chrset(filep->unitHorz, "FM") == true)
-                    filep->unitTime = 'S';
-                else if (chrset(filep->unitHorz, "KNS") == true)
-                    filep->unitTime = 'H';
-
-               }
-        }
-        // 'W', 'R', 'T' lines require previous field declaration 
-        else if ( (chrset(code, "WT") == true) && (strlen(fieldDef) == 0) ) {
-            status.code = NOFORM;
-            break;
         }
-        // 'W' line is route leg
-        else if ( (code == 'W') && (isRoute == true) ) {
-            int n_legs = ++(*(filep->route + filep->nroutes - 1))->npoints;
-            GpRoute *rp = realloc( *(filep->route + filep->nroutes - 1),
-                                  sizeof(GpRoute) + (n_legs * sizeof(int)) );
-            assert(rp != NULL);
-			*(filep->route + filep->nroutes - 1) = rp;
-            
-            status.code = scanGpLeg(buf,fieldDef,filep->waypt,filep->nwaypts,
-                                    *(filep->route + filep->nroutes - 1));
-            if (status.code != OK)
-                break;
+        reader->badRoute = false;
+    }
+    // scan new trackpoint
+    else if (code == 'T') {
+        PROF(GP_PROF_ALLOC,
+             filep->trkpt = realloc(filep->trkpt,
+                               (filep->ntrkpts + 1) * sizeof(GpTrkpt)));
+        PROF_ALLOC((filep->ntrkpts + 1) * sizeof(GpTrkpt));
+        assert(filep->trkpt != NULL);
+        GpTrkpt *tp = filep->trkpt + filep->ntrkpts;
+        err = scanGpTrkpt(buf, reader->fieldDef, filep->dateFormat, tp);
+        if (err != OK)
+            return err;
+        filep->ntrkpts++;
+
+        // the trackpoint skipped may have started a segment, so the next
+        // one does, its distance & duration from the old start as the base
+        if (tp->segFlag == true) {
+            reader->baseDist = 0;
+            reader->baseDuration = 0;
         }
-        // 'W' line is waypoint
-        else if ( (code == 'W') && (isRoute == false) ) {
-            filep->waypt = realloc(filep->waypt,
-                                   (filep->nwaypts + 1)*sizeof(GpWaypt));
-            assert(filep->waypt != NULL);
-            status.code = scanGpWaypt(buf,fieldDef,
-                                      filep->waypt + filep->nwaypts);
-            if (status.code != OK)
-                break;
-            filep->nwaypts++;
+        else if (reader->trkptSkipped == true) {
+            reader->baseDist = tp->dist;
+            reader->baseDuration = tp->duration;
+            tp->segFlag = true;
+            tp->comment = newstr("");
+            tp->dist = tp->speed = 0;
+            tp->duration = 0;
         }
-        // 'R' line starts new route
-        else if (code == 'R') {
-            filep->route = realloc(filep->route,
-                                   (filep->nroutes + 1)*sizeof(GpRoute *));
-            assert(filep->route != NULL);
-            *(filep->route + filep->nroutes) = malloc(sizeof(GpRoute));
-            assert(*(filep->route + filep->nroutes) != NULL);
-            status.code = scanGpRoute(buf, *(filep->route + filep->nroutes));
-            if (status.code != OK)
-                break;
-            filep->nroutes++;
-            // check for duplicate routes
-            for (int i = 0; i < (filep->nroutes - 1); i++) {
-                if ( (*(filep->route + i))->number == (*(filep->route
-                        + filep->nroutes - 1))->number ) {
-                    freeGpFile(filep);
-                    status.code = DUPRT;
-                    return status;
-                }
-            }
-            isRoute = true;
+        else {
+            tp->dist -= reader->baseDist;
+            tp->duration -= reader->baseDuration;
         }
-        // scan new trackpoint
-        else if (code == 'T') {
-            filep->trkpt = realloc(filep->trkpt,
-                                   (filep->ntrkpts + 1) * sizeof(GpTrkpt));
-            assert(filep->trkpt != NULL);
-            status.code = scanGpTrkpt(buf, fieldDef, filep->dateFormat,
-                                      filep->trkpt + filep->ntrkpts);
-            if (status.code != OK)
-                break;
-            filep->ntrkpts++;
+        reader->trkptSkipped = false;
+    }
+
+    return OK;
+}
+
+
+/*  Add status to the *ndiag problems in *diag  */
+static void noteGpError( GpStatus **diag, int *ndiag, const GpStatus status ) {
+
+    *diag = realloc(*diag, (*ndiag + 1) * sizeof(GpStatus));
+    assert(*diag != NULL);
+    (*diag)[(*ndiag)++] = status;
+}
+
+
+/*  Scan the lines of gpf into filep, from where reader left off. A last line
+    without its end of line is left for the next call unless whole is true.
+    Paramaters: diag, if not NULL, gets each line in error, which is skipped
+                (*ndiag of them, initially 0), instead of stopping there; the
+                trackpoint after one skipped among the trackpoints starts a
+                segment
+    Returns:    status of the first line in error, if any, or of an I/O
+                error  */
+static GpStatus readGpLines( FILE *const gpf, GpReader *reader, GpFile *filep,
+                             const _Bool whole, GpStatus **diag,
+                             int *ndiag ) {
+
+    char buf[BUFSIZE];
+    GpStatus status = { OK, reader->lineno };
+
+    for ( ; feof(gpf) == 0; status.lineno++) {
+        char *line;
+        size_t len;
+        memset(buf,'\0',BUFSIZE);
+        PROF(GP_PROF_LINES, line = fgets(buf, BUFSIZE, gpf));
+        if (line == NULL)
+            break;
+
+        // a line still being written
+        len = strlen(buf);
+        if ( (whole == false) && (feof(gpf) != 0) && (buf[len - 1] != '\n') )
+            break;
+
+        reader->offset += len;
+        status.code = scanGpRecord(buf, reader, filep);
+        if (status.code != OK && diag != NULL) {
+            noteGpError(diag, ndiag, status);
+            status.code = OK;
+            // among the trackpoints, a line in error may have been one
+            if (buf[0] == 'T' || filep->ntrkpts > 0)
+                reader->trkptSkipped = true;
         }
+        if (status.code != OK)
+            break;
     }
-    // free memory if an error occured
+    reader->lineno = status.lineno;
     if (ferror(gpf) != 0)
         status.code = IOERR;
-    if (status.code != OK)
-        freeGpFile(filep);
 
     return status;
 }
 
-void freep(void **p) {
-    if (p == NULL || *p == NULL)
-        return;
-    void *t = *p;
-    *p = NULL;
-    free(t);
-}
 
-void freeGpRoutes(GpFile *filep) {
+static GpStatus readGpRecords( FILE *const gpf, GpFile *filep ) {
 
-    if (filep->route == NULL)
-        return;
+    GpReader reader;
+    GpStatus status;
 
-    for (int i = 0; i < filep->nroutes; i++) {
-        freep((void **)&(*(filep->route + i))->comment);
-        freep((void **)(filep->route + i));
-    }
-    freep((void **)&filep->route);
+    initGpReader(&reader, filep);
+    status = readGpLines(gpf, &reader, filep, true, NULL, NULL);
+
+    // free memory if an error occured
+    if (status.code != OK)
+        freeGpFile(filep);
+    freeGpReader(&reader);
+
+    return status;
 }
 
 
-void freeGpWaypts(GpFile *filep) {
+GpStatus readGpFile( FILE *const gpf, GpFile *filep ) {
 
-    if (filep->waypt == NULL)
-        return;
+    GpCompression how;
+    FILE *in = openGpInput(gpf, &how);
+    GpStatus status = { IOERR, 1 };
 
-    for (int i = 0; i < filep->nwaypts; i++) {
-        freep((void **)&(filep->waypt + i)->ID);
-        freep((void **)&(filep->waypt + i)->symbol);
-        freep((void **)&(filep->waypt + i)->comment);
+    if (in == NULL) {
+        GpFile f = { NULL, GP_TIMEZONE, GP_UNITHORZ, GP_UNITTIME, 0, NULL,
+                     0, NULL, 0, NULL };
+        *filep = f;
+        return status;
     }
-    freep((void **)&filep->waypt);
+    PROF(GP_PROF_READ, status = readGpRecords(in, filep));
+    if (in != gpf)
+        fclose(in);
+    return status;
 }
 
 
-void freeGpTrkpts(GpFile *filep) {
+/*  Read gpf as readGpFile does, but skip each line in error instead of
+    stopping there, keeping the rest in filep. A route in error is skipped
+    along with its legs, and the trackpoint after one skipped starts a
+    segment with a blank comment, so that two tracks can't run together.
+    Paramaters: *diag is set to a malloc'd array of the lines in error, in
+                order, ending with any I/O error
+    Returns:    the no. of entries in *diag  */
+int readGpFileLenient( FILE *const gpf, GpFile *filep, GpStatus **diag ) {
 
-    if (filep->trkpt == NULL)
-        return;
+    GpCompression how;
+    FILE *in = openGpInput(gpf, &how);
+    GpReader reader;
+    GpStatus status = { IOERR, 1 };
+    int ndiag = 0;
 
-    for (int i = 0; i < filep->ntrkpts; i++)
-        freep((void **)&(filep->trkpt + i)->comment);
+    *diag = NULL;
+    initGpReader(&reader, filep);
+    if (in == NULL) {
+        noteGpError(diag, &ndiag, status);
+        return ndiag;
+    }
+    PROF(GP_PROF_READ, status = readGpLines(in, &reader, filep, true, diag,
+                                            &ndiag));
+    if (status.code != OK)
+        noteGpError(diag, &ndiag, status);
+    if (in != gpf)
+        fclose(in);
+    freeGpReader(&reader);
 
-    freep((void **)&filep->trkpt);
+    // the first trackpoint left must start a track
+    if (filep->ntrkpts > 0 && filep->trkpt[0].segFlag == false) {
+        filep->trkpt[0].segFlag = true;
+        filep->trkpt[0].comment = newstr("");
+    }
+    return ndiag;
 }
 
 
-void freeGpFile( GpFile *filep ) {
+/*  Start reading a GPSU file from its first line, setting filep to an empty
+    file with the default settings  */
+void initGpReader( GpReader *reader, GpFile *filep ) {
 
-    if (filep == NULL)
-        return;
+    GpFile f = {
+        newstr(GP_DATEFORMAT), GP_TIMEZONE, GP_UNITHORZ, GP_UNITTIME, 0, NULL,
+        0, NULL, 0, NULL
+    };
+    *filep = f;
 
-    freep((void **)&filep->dateFormat);
-    freeGpWaypts(filep);
-    freeGpRoutes(filep);
-    freeGpTrkpts(filep);   
+    memset(reader, 0, sizeof(GpReader));
+    reader->lineno = 1;
 }
 
 
-GpError scanGpWaypt( const char *buff, const char *fieldDef, GpWaypt *wp ) {
+/*  Extend the track summaries in reader with the trackpoints added to filep
+    since the last call, as getGpTracks would summarize them  */
+static void updateGpTracks( GpReader *reader, const GpFile *filep ) {
 
-    int n_fields = str_count_toks(fieldDef, " \t") - 1;
-    GpFieldHeader head[n_fields];
-    char fields[n_fields][MAX_FIELD_LENGTH];
-    char *id = NULL, *lat = NULL, *lon = NULL;
-    char *symbol = NULL, *comment = NULL;
-    GpError err = OK;
-    
-    wp->textChoice = 'I';
-    wp->textPlace = 2;
-    
-    if (strspn(buff+1, SPACE) == strlen(buff+1))
-        return FIELD;
-    
-    if ( (err = parseGpFieldDef(fieldDef, head)) != OK)
-        return err;
-    
-    if ( (err = parseGpLine(buff, fields, head, n_fields)) != OK)
-        return err;
-    
-    for (int i = 0; i < n_fields; i++) {
-        switch(head[i].type) {
-            case ID:
-                id = fields[i];
-                break;
-            case LAT:
-                lat = fields[i];
-                break;
-            case LON:
-                lon = fields[i];
-                break;
-            case ALT:
-                break;
-            case SYM:
-                symbol = fields[i];
-                break;
-            case TXCHO:
-                if (chrset(*fields[i], "-IC&+^") == true)
-                    wp->textChoice = *fields[i];
-                else
-                    return VALUE;
-                break;
-            case TXPLA:
-                for (int j = 0; j <= 8; j++) {
-                    char textPlace[][3] = { "N","NE","E","SE",
-                                             "S","SW","W","NW" };
-                    if (j == 8) {
-                        return VALUE;
-                    }
-                    else if (strcmp(textPlace[j],fields[i]) == 0) {
-                        wp->textPlace = j;
-                        break;
-                    }
-                }
-                break;
-            case COMMENT:
-                comment = fields[i];
-                break;
-            default:
-                return FIELD;
+    for (int i = reader->ntrkpts; i < filep->ntrkpts; i++) {
+        GpTrkpt *tp = filep->trkpt + i;
+        GpTrack *track;
+
+        if (tp->segFlag == true) {
+            reader->track = realloc(reader->track,
+                                    (reader->ntracks + 1) * sizeof(GpTrack));
+            assert(reader->track != NULL);
+            track = reader->track + reader->ntracks++;
+            track->seqno = i + 1;
+            track->startTrk = track->endTrk = tp->dateTime;
+            track->duration = 0;
+            track->dist = 0;
+            track->speed = 0;
+            track->NEcorner = track->SWcorner = track->meanCoord = tp->coord;
+            continue;
         }
+        // not part of a track
+        else if (reader->ntracks == 0) {
+            continue;
+        }
+
+        track = reader->track + reader->ntracks - 1;
+        track->endTrk = tp->dateTime;
+        track->duration = tp->duration;
+        track->dist = tp->dist;
+        track->speed = (tp->duration > 0) ? tp->dist / tp->duration : 0;
+        if (filep->unitTime == 'H')
+            track->speed *= 3600;
+        track->NEcorner.lat = MAX(tp->coord.lat, track->NEcorner.lat);
+        track->NEcorner.lon = MAX(tp->coord.lon, track->NEcorner.lon);
+        track->SWcorner.lat = MIN(tp->coord.lat, track->SWcorner.lat);
+        track->SWcorner.lon = MIN(tp->coord.lon, track->SWcorner.lon);
+        track->meanCoord.lat = (track->NEcorner.lat + track->SWcorner.lat) / 2;
+        track->meanCoord.lon = (track->NEcorner.lon + track->SWcorner.lon) / 2;
     }
+    reader->ntrkpts = filep->ntrkpts;
+}
 
-    if ( (id == NULL) || (lat == NULL) || (lon == NULL) )
-        return FIELD;
-    
-    if (parseGpCoords(lat, lon, &(wp->coord)) != OK)
-        return VALUE;
 
-    // parsing succeeded, allocate memory for id, symbol and comment
-    wp->ID = newstr(id);
-    wp->symbol = ( symbol == NULL ? newstr("") : newstr(symbol) );
-    wp->comment = ( comment == NULL ? newstr("") : newstr(comment) );
+/*  Read the lines appended to gpf since reader left off into filep, and bring
+    the track summaries in reader up to date. A last line without its end of
+    line, still being written, is left for the next call.
+    Paramaters: gpf is a seekable GPSU file
+                reader and filep were set by initGpReader, and either
+                left as the last call to resumeGpFile left them
+    Returns:    status of the first line in error, if any; the records before
+                it are kept  */
+GpStatus resumeGpFile( FILE *const gpf, GpReader *reader, GpFile *filep ) {
 
-    return OK;
-}
+    GpStatus status = { OK, reader->lineno };
 
+    clearerr(gpf);
+    if (fseek(gpf, reader->offset, SEEK_SET) != 0) {
+        status.code = IOERR;
+        return status;
+    }
+    PROF(GP_PROF_READ, status = readGpLines(gpf, reader, filep, false, NULL,
+                                             NULL));
+    updateGpTracks(reader, filep);
 
-GpError scanGpRoute( const char *buff, GpRoute *rp ) {
+    return status;
+}
 
-    char *comment;
-    
-    if (strspn(buff+1, SPACE) == strlen(buff+1))
-        return FIELD;
-    
-    rp->number = (int)strtol(buff+1, &comment, 10);
-    if ( (rp->number < 0) || ((buff+1) == comment) )
-        return VALUE;
-    else if ( (*comment != '\0') && (chrset(*comment, SPACE) == false) )
-        return VALUE;
 
-    comment += strspn(comment, SPACE);
-    rp->comment = newstr(comment);
-    rp->npoints = 0;
-    return OK;
+void freeGpReader( GpReader *reader ) {
+
+    free(reader->track);
+    reader->track = NULL;
+    reader->ntracks = 0;
+    reader->ntrkpts = 0;
 }
 
 
-GpError scanGpLeg(const char *buff, const char *fieldDef, const GpWaypt *wp,
-                  const int nwp, GpRoute *rp) {
+/*  Find where each of the n_fields fields of buf starts and how long it is,
+    splitting the line as parseGpLine does but without copying anything.
+    A set segment flag ends the line, its field being the comment after it.
+    Paramaters: field and len are allocated arrays of n_fields elements
+    Returns:    FIELD or VALUE as parseGpLine would  */
+static GpError locateGpFields(const char *buf, const GpFieldHeader *head,
+                              int n_fields, const char **field, int *len) {
 
-    int n_fields = str_count_toks(fieldDef, SPACE) - 1;
-    char *id = NULL;
-    GpFieldHeader head[n_fields];    
-    char fields[n_fields][MAX_FIELD_LENGTH];
-    GpError err = OK;
+    const char *start = buf + 1;
+    for (int i = 0; i < n_fields; i++) {
+        const char *end;
 
-    if (strspn(buff+1, SPACE) == strlen(buff+1))
-        return FIELD;
+        if ( (head[i].type != COMMENT) && (chrset(*start, SPACE) == false) )
+            return FIELD;
 
-    if ( (err = parseGpFieldDef(fieldDef, head)) != OK)
-        return err;
-    
-    if ( (err = parseGpLine(buff, fields, head, n_fields)) != OK)
-        return err;
+        start += strspn(start, SPACE);
+        field[i] = start;
 
-    for (int i = 0; i < n_fields; i++) {
-        if (head[i].type == ID) {
-            id = fields[i];
-            break;
+        if (head[i].type == SEGFLAG) {
+            if ( (*(start+1) != '\0') && (chrset(*(start+1), SPACE) == false) )
+                return VALUE;
+
+            if (*start == '1') {
+                field[i] = (*(start+1) == '\0') ? start + 1 : start + 2;
+                len[i] = -1;
+                return OK;
+            }
+            else if (*start != '0') {
+                return VALUE;
+            }
+            len[i] = 1;
+        }
+        else if (head[i].len == 0) {
+            len[i] = strcspn(start, SPACE);
+        }
+        else if (head[i].len == -1) {
+            len[i] = strlen(start);
+        }
+        else {
+            len[i] = head[i].len;
         }
+        // don't run past the end of a short line
+        end = memchr(start, '\0', len[i]);
+        start = (end == NULL) ? start + len[i] : end;
     }
-    
-    if (id == NULL)
+    // nothing but blanks after the last field
+    if (start[strspn(start, SPACE)] != '\0')
         return FIELD;
-        
-    for (int i = 0; i < nwp; i++) {
-        if (strcmp((wp + i)->ID, id) == 0) {
-            rp->leg[rp->npoints - 1] = i;
-            return OK;
-        }
-    }    
-    
-    return UNKWPT;
+    return OK;
 }
 
 
-GpError scanGpTrkpt( const char *buff, const char *fieldDef,
-                    const char *dateFormat, GpTrkpt *tp ) {
+/*  Copy the field at start into dst as parseGpLine would  */
+static void copyGpField(char *dst, const char *start, int len) {
 
-    int n_fields = str_count_toks(fieldDef, SPACE) - 1;
-    GpFieldHeader head[n_fields];
-    char fields[n_fields][MAX_FIELD_LENGTH];
+    int n;
+
+    if (len == -1)
+        len = strlen(start);
+    // as sprintf "%-*.*s", without the format parsing
+    n = strnlen(start, len);
+    memcpy(dst, start, n);
+    memset(dst + n, ' ', len - n);
+    dst[len] = '\0';
+}
+
+
+typedef struct {    // waypoint IDs seen by scanGpInfoRecords, for route legs
+    char **slot;        // hash table of IDs, NULL free
+    int nslots;         // its size, a power of 2 over twice the IDs
+    int n;              // no. of IDs
+} GpIDSet;
+
+/*  Slot of ID in set, or of the free slot where it would go  */
+static int findGpID( const GpIDSet *set, const char *ID ) {
+
+    unsigned long h = 2166136261UL;     // FNV-1a
+    int slot;
+
+    for (const char *p = ID; *p != '\0'; p++)
+        h = (h ^ (unsigned char)*p) * 16777619UL;
+    slot = h & (set->nslots - 1);
+    while (set->slot[slot] != NULL && strcmp(set->slot[slot], ID) != 0)
+        slot = (slot + 1) & (set->nslots - 1);
+    return slot;
+}
+
+static void addGpID( GpIDSet *set, const char *ID ) {
+
+    int slot;
+
+    if (2 * (set->n + 1) > set->nslots) {
+        GpIDSet old = *set;
+        set->nslots = (old.nslots == 0) ? 64 : 2 * old.nslots;
+        set->slot = calloc(set->nslots, sizeof(char *));
+        assert(set->slot != NULL);
+        for (int i = 0; i < old.nslots; i++)
+            if (old.slot[i] != NULL)
+                set->slot[findGpID(set, old.slot[i])] = old.slot[i];
+        free(old.slot);
+    }
+    slot = findGpID(set, ID);
+    if (set->slot[slot] == NULL) {
+        set->slot[slot] = newstr((char *)ID);
+        set->n++;
+    }
+}
+
+static void freeGpIDSet( GpIDSet *set ) {
+
+    for (int i = 0; i < set->nslots; i++)
+        free(set->slot[i]);
+    free(set->slot);
+}
+
+
+/*  Parse an elapsed time as H:MM:SS, under 24 hours, into seconds
+    Returns:    VALUE if it isn't one, else OK  */
+static GpError parseGpDuration( const char *str, long *duration ) {
+
+    int h, m, s;
+
+    if ( (sscanf(str, "%d:%d:%d", &h, &m, &s) != 3)
+        || (h >= 24) || (h < 0) || (m >= 60) || (m < 0)
+        || (s >= 60) || (s < 0) )
+        return VALUE;
+    *duration = h * 60 * 60 + m * 60 + s;
+    return OK;
+}
+
+
+/*  Check the n located fields of a waypoint line, in order, for the types
+    and values scanGpWaypt would reject.
+    Returns:    FIELD or VALUE as scanGpWaypt would, else OK  */
+static GpError checkGpWayptValues( const GpFieldHeader *head,
+                                   const char **field, const int *len,
+                                   const int n ) {
+
+    char textPlace[][3] = { "N","NE","E","SE","S","SW","W","NW" };
+
+    for (int i = 0; i < n; i++) {
+        char value[MAX_FIELD_LENGTH];
+        GpFieldType t = head[i].type;
+        int j = 0;
+
+        if ( (t == TXCHO) || (t == TXPLA) )
+            copyGpField(value, field[i], len[i]);
+        if (t > COMMENT)
+            return FIELD;
+        else if ( (t == TXCHO) && (chrset(*value, "-IC&+^") == false) )
+            return VALUE;
+        while ( (t == TXPLA) && (j < 8) && (strcmp(textPlace[j], value) != 0) )
+            j++;
+        if (j == 8)
+            return VALUE;
+    }
+    return OK;
+}
+
+
+/*  Check the first n located fields of a trackpoint line, in order, for the
+    types and values scanGpTrkpt would reject. The date & time are parsed with
+    strptime but not converted, which is where reading spends its time.
+    Paramaters: cut is true if a set segment flag follows the n fields
+    Returns:    FIELD or VALUE as scanGpTrkpt would, bar the coordinates  */
+static GpError checkGpTrkptValues( const GpFieldHeader *head,
+                                   const char **field, const int *len,
+                                   const int n, const _Bool cut,
+                                   const char *dateFormat ) {
 
-    char *lat = NULL, *lon = NULL, *comment = NULL;
     char dateBuf[MAX_FIELD_LENGTH] = "";
     char dateFormBuf[MAX_FIELD_LENGTH] = "";
     int validFields = 0;
     struct tm tm;
-    GpError err = OK;
-
-    memset(&tm,0,sizeof(struct tm));
-    memset(tp,0,sizeof(GpTrkpt));
+    char *p;
 
-    if ( (err = parseGpFieldDef(fieldDef, head)) != OK)
-        return err;
-    
-    if ( (err = parseGpLine(buff, fields, head, n_fields)) != OK)
-        return err;
-
-    for (int i = 0; i < n_fields; i++) {
+    for (int i = 0; i < n; i++) {
+        char value[MAX_FIELD_LENGTH];
         GpFieldType t = head[i].type;
+        long duration;
 
-        if (t == LAT) {
-            lat = fields[i];
-        }
-        else if (t == LON) {
-            lon = fields[i];
-        }
-        else if (t == ALT) {
+        if (t == ALT)
             continue;
-        }
-        else if (t == DATE) {
-            strcat(dateBuf, fields[i]);
+        // only the values checked need copying
+        if ( (t != LAT) && (t != LON) && (t != SEGFLAG) )
+            copyGpField(value, field[i], len[i]);
+        if (t == DATE) {
+            strcat(dateBuf, value);
             strcat(dateFormBuf, dateFormat);
         }
         else if (t == TIME) {
-            strcat(dateBuf, fields[i]);
+            strcat(dateBuf, value);
             strcat(dateFormBuf, " %H:%M:%S ");
         }
-        else if (t == SEGFLAG) {
-            if (strcmp(fields[i],"0") == 0) {
-                tp->segFlag = false;
-            }
-            else {
-                comment = fields[i];
-                tp->segFlag = true;
-                break;
-            }
-        }
         else if (t == SECONDS) {
-            char *p;
-            tp->duration = strtol(fields[i], &p, 10);
-            if ( (p == NULL) || (*p != '\0') )
-                return VALUE;
-        }
-        else if (t == DUR) {
-            int h, m, s;
-            if (sscanf(fields[i], "%d:%d:%d", &h, &m, &s) != 3)
-                return VALUE;            
-            if ( (h >= 24) || (h < 0) )
-                return VALUE;
-            else
-                tp->duration = h * 60 * 60;
-                
-            if ( (m >= 60) || (m < 0) )
-                return VALUE;
-            else
-                tp->duration += m * 60;
-                
-            if ( (s >= 60) || (s < 0) )
+            strtol(value, &p, 10);
+            if (*p != '\0')
                 return VALUE;
-            else
-                tp->duration += s;
         }
-        else if (t == DIST) {
-            char *p = NULL;
-            tp->dist = strtod(fields[i], &p);
+        else if ( (t == DIST) || (t == SPEED) ) {
+            strtod(value, &p);
             if (*p != '\0')
                 return VALUE;
         }
-        else if (t == SPEED) {
-            char *p = NULL;
-            tp->speed = (float)strtod(fields[i], &p);
-            if (*p != '\0')
+        else if (t == DUR) {
+            if (parseGpDuration(value, &duration) != OK)
                 return VALUE;
         }
-        else {
+        else if ( (t != LAT) && (t != LON) && (t != SEGFLAG) ) {
             return FIELD;
         }
         validFields++;
     }
-    
-    if ( (tp->segFlag == false) && (validFields < 8) )
+    if ( (cut == false) && (validFields < 8) )
         return FIELD;
 
-    if ( (lat != NULL) && (lon != NULL ) &&
-         (parseGpCoords(lat, lon, &(tp->coord)) != OK) )
-        return VALUE;
-
-    char *p = strptime(dateBuf, dateFormBuf, &tm);
-    if ( (p == NULL) || (*p != '\0') ) {
+    memset(&tm, 0, sizeof(struct tm));
+    PROF(GP_PROF_TIMES, p = strptime(dateBuf, dateFormBuf, &tm));
+    if ( (p == NULL) || (*p != '\0') )
         return VALUE;
-    }
-    else {
-        tm.tm_isdst = -1;
-        tp->dateTime = mktime(&tm);
-        if (tp->dateTime == -1)
-            return VALUE;
-    }
-    tp->comment = newstr(comment);
-    
     return OK;
 }
 
 
-int getGpTracks( const GpFile *filep, GpTrack **tp ) {
+static GpStatus scanGpInfoRecords( FILE *const gpf, GpFileInfo *info ) {
 
-    int n_tracks = 0;
-    *tp = NULL;
-    GpCoord NE = {-91, -181}, SW = {91, 181};
-    
-    for (int i = 0; i < filep->ntrkpts; i++) {
-        GpTrkpt *cur_tp = filep->trkpt + i;
-        if (cur_tp->segFlag == false || n_tracks == 0) {
-            if ((cur_tp->coord).lat > NE.lat)
-                NE.lat = (cur_tp->coord).lat;
-            if ((cur_tp->coord).lat < SW.lat)
-                SW.lat = (cur_tp->coord).lat;
-            if ((cur_tp->coord).lon > NE.lon)
-                NE.lon = ((cur_tp)->coord).lon;
-            if ((cur_tp->coord).lon < SW.lon)
-                SW.lon = ((cur_tp)->coord).lon;
-        }
-        // end of segment
-        if ( ( (cur_tp->segFlag == true) && (n_tracks > 0) )
-            || (i == (filep->ntrkpts - 1))) {
-            GpTrkpt *prev_tp = filep->trkpt + i;
-            if (cur_tp->segFlag == true)
-                prev_tp--;
-            (*tp + n_tracks - 1)->endTrk = prev_tp->dateTime;
-            (*tp + n_tracks - 1)->duration = prev_tp->duration;
-            (*tp + n_tracks - 1)->dist = prev_tp->dist;
-            (*tp + n_tracks - 1)->speed = prev_tp->dist / prev_tp->duration;
-            if (filep->unitTime == 'H')
-                (*tp + n_tracks - 1)->speed *= 3600;
-            ((*tp + n_tracks - 1)->meanCoord).lat = (NE.lat + SW.lat) / 2;
-            ((*tp + n_tracks - 1)->meanCoord).lon = (NE.lon + SW.lon) / 2;
-            (*tp + n_tracks - 1)->NEcorner = NE;
-            (*tp + n_tracks - 1)->SWcorner = SW;
-        }
-        // start of new segment
-        if (cur_tp->segFlag == true) {
-            *tp = realloc(*tp, ((n_tracks + 1) * sizeof (GpTrack)));
-            assert(*tp != NULL);
-            (*tp + n_tracks)->seqno = i+1;
-            (*tp + n_tracks)->startTrk = cur_tp->dateTime;
-            NE = SW = cur_tp->coord;
-            n_tracks++;
-        }
-        // check NE and SW bounds
-        else {
+    char buf[BUFSIZE];
+    char prevID[MAX_FIELD_LENGTH] = "";
+    char dateFormat[MAX_FIELD_LENGTH] = GP_DATEFORMAT;
+    GpFile settings = { dateFormat, GP_TIMEZONE, GP_UNITHORZ, GP_UNITTIME,
+                        0, NULL, 0, NULL, 0, NULL };
+    _Bool haveDef = false, isRoute = false;
+    GpFieldHeader head[BUFSIZE / 2];
+    GpError defErr = OK, err;
+    int nFields = 0;
+    int idField = -1, latField = -1, lonField = -1, segField = -1;
+    GpIDSet ids = { NULL, 0, 0 };   // for route legs
+    int *routeNum = NULL;   // route numbers so far, ascending
+    GpStatus status;
 
-        }
-    }    
-    return n_tracks;
-}
+    GpFileInfo f = { 0, 0, 0, 0, true, { -91, -181 }, { 91, 181 } };
+    *info = f;
 
+    for (status.lineno = 1, status.code = OK; feof(gpf) == 0; status.lineno++) {
+        const char *field[BUFSIZE / 2];
+        int len[BUFSIZE / 2];
+        char lat[MAX_FIELD_LENGTH], lon[MAX_FIELD_LENGTH];
+        char id[MAX_FIELD_LENGTH];
+        char code;
+        GpCoord coord = { 0, 0 };
+        _Bool inExtent = false;
 
-int writeGpFile( FILE *const gpf, const GpFile *filep ) {
+        char *line;
+        PROF(GP_PROF_LINES, line = fgets(buf, BUFSIZE, gpf));
+        if (line == NULL)
+            break;
 
-    char buf[BUFSIZE] = "";
-    int COUNT = 1;
-    int id_len = 0, sym_len = 0, com_len = 0;
+        // validate first 2 bytes, as readGpFile
+        code = buf[0];
+        if (chrset(code, "CAH\n\r") == true) {
+            continue;
+        }
+        else if (chrset(code, "ISMUFWRT") == false) {
+            status.code = UNKREC;
+            break;
+        }
+        else if (buf[1] != ' ') {
+            status.code = BADSEP;
+            break;
+        }
 
-    // file header, I, S, M and U lines
-    GPRINTLN("H  SOFTWARE NAME & VERSION\n");
-    GPRINTLN("I  GPSU 4.20 01 FREEWARE VERSION\n");
-    GPRINTLN("\n");
+        if (strpbrk(buf, "\n\r") != NULL)
+            *strpbrk(buf, "\n\r") = '\0';
 
-    sscanf(filep->dateFormat, "%%%*c/%%%c/%%%c", buf, buf + 1);
-    GPRINTLN("S DateFormat=dd/%s/%s\n", (buf[0] == 'm') ? "mm" : "mmm",
-            (buf[1] == 'y') ? "yy" : "yyyy");
-    GPRINTLN("S Timezone=%+d:00\n", filep->timeZone);
-    GPRINTLN("S Units=%c\n", filep->unitHorz);
-    GPRINTLN("\n");
-    
-    GPRINTLN("H R DATUM\n");
-    GPRINTLN("M E            WGS 84 100  0.0000000E+00  0.0000000E+00 0 0 0\n");
-    GPRINTLN("\n");
+        if ( (isRoute == true) && (chrset(code, "FW") == false) )
+            isRoute = false;
+
+        if ( (code == 'I') && (strcmp_ic(strtok(buf+1, SPACE), "GPSU") != 0) ) {
+            status.code = FILTYP;
+            break;
+        }
+        else if ( (code == 'M') && (strstr_ic(buf, "WGS 84") == NULL) ) {
+            status.code = DATUM;
+            break;
+        }
+        else if ( (code == 'U') && (strstr_ic(buf, "LAT LON DEG") == NULL) ) {
+            status.code = COORD;
+            break;
+        }
+        // the date format is needed to check trackpoint dates
+        else if (code == 'S') {
+            if ( (status.code = scanGpSetting(buf, &settings)) != OK)
+                break;
+        }
+        // note where the wanted columns are, once per 'F' line
+        else if (code == 'F') {
+            int n_fields = nFields = str_count_toks(buf, SPACE) - 1;
+            haveDef = true;
+            idField = latField = lonField = segField = -1;
+            PROF(GP_PROF_FIELDDEF, defErr = parseGpFieldDef(buf, head));
+            for (int i = 0; i < n_fields && defErr == OK; i++) {
+                GpFieldType t = head[i].type;
+                if (t == ID)
+                    idField = i;
+                else if (t == LAT)
+                    latField = i;
+                else if (t == LON)
+                    lonField = i;
+                else if (t == SEGFLAG)
+                    segField = i;
+            }
+        }
+        else if ( (chrset(code, "WT") == true) && (haveDef == false) ) {
+            status.code = NOFORM;
+            break;
+        }
+        // route numbers must be unique, as readGpFile
+        else if (code == 'R') {
+            GpRoute route;
+            int lo = 0, hi = info->nroutes;
+
+            if ( (status.code = scanGpRoute(buf, &route)) != OK)
+                break;
+            free(route.comment);
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (routeNum[mid] < route.number)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            if ( (lo < info->nroutes) && (routeNum[lo] == route.number) ) {
+                status.code = DUPRT;
+                break;
+            }
+            routeNum = realloc(routeNum, (info->nroutes + 1) * sizeof(int));
+            assert(routeNum != NULL);
+            memmove(routeNum + lo + 1, routeNum + lo,
+                    (info->nroutes - lo) * sizeof(int));
+            routeNum[lo] = route.number;
+            info->nroutes++;
+            isRoute = true;
+        }
+        // a route leg must name a waypoint already read
+        else if (code == 'W' && isRoute == true) {
+            if (strspn(buf+1, SPACE) == strlen(buf+1)) {
+                status.code = FIELD;
+                break;
+            }
+            if ( (status.code = defErr) != OK)
+                break;
+            PROF(GP_PROF_SPLIT,
+                 status.code = locateGpFields(buf, head, nFields, field, len));
+            if (status.code != OK)
+                break;
+            if (idField == -1) {
+                status.code = FIELD;
+                break;
+            }
+            copyGpField(id, field[idField], len[idField]);
+            if ( (ids.n == 0) || (ids.slot[findGpID(&ids, id)] == NULL) ) {
+                status.code = UNKWPT;
+                break;
+            }
+        }
+        else if ( (code == 'W') && (isRoute == false) ) {
+            if (strspn(buf+1, SPACE) == strlen(buf+1)) {
+                status.code = FIELD;
+                break;
+            }
+            if ( (status.code = defErr) != OK)
+                break;
+            PROF(GP_PROF_SPLIT,
+                 status.code = locateGpFields(buf, head, nFields, field, len));
+            if (status.code != OK)
+                break;
+            status.code = checkGpWayptValues(head, field, len, nFields);
+            if ( (status.code == OK) && ( (idField == -1) || (latField == -1)
+                                         || (lonField == -1) ) )
+                status.code = FIELD;
+            if (status.code != OK)
+                break;
+
+            copyGpField(lat, field[latField], len[latField]);
+            copyGpField(lon, field[lonField], len[lonField]);
+            PROF(GP_PROF_COORDS, err = parseGpCoords(lat, lon, &coord));
+            if (err != OK) {
+                status.code = VALUE;
+                break;
+            }
+            copyGpField(id, field[idField], len[idField]);
+            if ( (info->nwaypts > 0) && (strcmp(id, prevID) < 0) )
+                info->sorted = false;
+            strcpy(prevID, id);
+            addGpID(&ids, id);
+            info->nwaypts++;
+            inExtent = true;
+        }
+        else if (code == 'T') {
+            _Bool segFlag = false, cut = false;
+
+            if ( (status.code = defErr) != OK)
+                break;
+            PROF(GP_PROF_SPLIT,
+                 status.code = locateGpFields(buf, head, nFields, field, len));
+            if (status.code != OK)
+                break;
+
+            // fields after a set segment flag are part of its comment
+            if ( (segField != -1) && (len[segField] == -1) ) {
+                cut = true;
+                segFlag = (strcmp(field[segField], "0") != 0);
+            }
+            status.code = checkGpTrkptValues(head, field, len,
+                              (cut == true) ? segField : nFields, cut,
+                              settings.dateFormat);
+            if (status.code != OK)
+                break;
+            if ( (latField != -1) && (lonField != -1)
+                && (cut == false || MAX(latField, lonField) < segField) ) {
+                copyGpField(lat, field[latField], len[latField]);
+                copyGpField(lon, field[lonField], len[lonField]);
+                PROF(GP_PROF_COORDS, err = parseGpCoords(lat, lon, &coord));
+                if (err != OK) {
+                    status.code = VALUE;
+                    break;
+                }
+            }
+            info->ntrkpts++;
+            if (segFlag == true)
+                info->ntracks++;
+            // points before the first segment aren't part of a track
+            inExtent = (info->ntracks > 0);
+        }
+
+        if (inExtent == false)
+            continue;
+        info->NEcorner.lat = MAX(coord.lat, info->NEcorner.lat);
+        info->NEcorner.lon = MAX(coord.lon, info->NEcorner.lon);
+        info->SWcorner.lat = MIN(coord.lat, info->SWcorner.lat);
+        info->SWcorner.lon = MIN(coord.lon, info->SWcorner.lon);
+    }
+    if (ferror(gpf) != 0)
+        status.code = IOERR;
+
+    freeGpIDSet(&ids);
+    free(routeNum);
+    return status;
+}
+
+
+/*  Count the waypoints, routes, trackpoints and tracks in gpf, noting whether
+    the waypoints are sorted by ID and the extent of the waypoints and tracks,
+    as gpstool -info reports them from a file read by readGpFile. Every
+    field readGpFile checks is checked, but nothing is kept: dates & times
+    are parsed without being converted, and only the waypoint IDs and route
+    numbers are remembered, for route legs and duplicate routes.
+    Paramaters: gpf is an open GPSU file
+                info is allocated and will store the results
+    Returns:    status as readGpFile would  */
+GpStatus scanGpFileInfo( FILE *const gpf, GpFileInfo *info ) {
+
+    GpCompression how;
+    FILE *in = openGpInput(gpf, &how);
+    GpStatus status = { IOERR, 1 };
+
+    if (in == NULL)
+        return status;
+    PROF(GP_PROF_READ, status = scanGpInfoRecords(in, info));
+    if (in != gpf)
+        fclose(in);
+    return status;
+}
+
+
+/*  A gzip stream read or written through a FILE  */
+typedef struct {
+    FILE *fp;           // compressed stream
+    _Bool writing;
+    _Bool ended;        // at the end of a gzip member
+    z_stream z;
+    unsigned char buf[ZBUFSIZE];
+} GpZStream;
+
+static ssize_t readGpZStream( void *cookie, char *out, size_t size ) {
+
+    GpZStream *zs = cookie;
+
+    zs->z.next_out = (unsigned char *)out;
+    zs->z.avail_out = size;
+    while (zs->z.avail_out > 0) {
+        int rc;
+        if (zs->z.avail_in == 0) {
+            zs->z.next_in = zs->buf;
+            zs->z.avail_in = fread(zs->buf, 1, ZBUFSIZE, zs->fp);
+            if (zs->z.avail_in == 0) {
+                // cut short
+                if (ferror(zs->fp) != 0 || zs->ended == false)
+                    return (zs->z.avail_out < size) ? size - zs->z.avail_out
+                                                    : -1;
+                break;
+            }
+        }
+        zs->ended = false;
+        rc = inflate(&zs->z, Z_NO_FLUSH);
+        // another member may follow, as from gzip -c a b
+        if (rc == Z_STREAM_END) {
+            zs->ended = true;
+            rc = inflateReset(&zs->z);
+        }
+        if (rc != Z_OK && rc != Z_BUF_ERROR)
+            return -1;
+    }
+    return size - zs->z.avail_out;
+}
+
+static ssize_t writeGpZStream( void *cookie, const char *in, size_t size ) {
+
+    GpZStream *zs = cookie;
+
+    zs->z.next_in = (unsigned char *)in;
+    zs->z.avail_in = size;
+    while (zs->z.avail_in > 0) {
+        zs->z.next_out = zs->buf;
+        zs->z.avail_out = ZBUFSIZE;
+        deflate(&zs->z, Z_NO_FLUSH);
+        if (fwrite(zs->buf, 1, ZBUFSIZE - zs->z.avail_out, zs->fp)
+            != ZBUFSIZE - zs->z.avail_out)
+            return 0;
+    }
+    return size;
+}
+
+static int closeGpZStream( void *cookie ) {
+
+    GpZStream *zs = cookie;
+    int rv = 0;
+
+    if (zs->writing == true) {
+        int rc;
+        do {
+            zs->z.next_out = zs->buf;
+            zs->z.avail_out = ZBUFSIZE;
+            rc = deflate(&zs->z, Z_FINISH);
+            if (fwrite(zs->buf, 1, ZBUFSIZE - zs->z.avail_out, zs->fp)
+                != ZBUFSIZE - zs->z.avail_out)
+                rv = EOF;
+        } while (rc == Z_OK);
+        deflateEnd(&zs->z);
+        if (fflush(zs->fp) != 0)
+            rv = EOF;
+    }
+    else {
+        inflateEnd(&zs->z);
+    }
+    free(zs);
+    return rv;
+}
+
+
+/*  Look at the start of fp for a compressed stream, and if there is one give
+    a stream of its uncompressed contents. Only gzip is recognized; a GPSU
+    file can't start with its 0x1f byte.
+    Paramaters: fp is open for reading, and nothing has been read from it
+                how will store the compression found
+    Returns:    fp itself if not compressed, a new stream to be closed with
+                fclose (which leaves fp open) if it is, or NULL on error  */
+FILE *openGpInput( FILE *const fp, GpCompression *how ) {
+
+    cookie_io_functions_t io = { readGpZStream, NULL, NULL, closeGpZStream };
+    GpZStream *zs;
+    FILE *in;
+    int c = getc(fp);
+
+    *how = GP_PLAIN;
+    if (c == EOF)
+        return fp;
+    ungetc(c, fp);
+    if (c != 0x1f)
+        return fp;
+
+    zs = calloc(1, sizeof(GpZStream));
+    assert(zs != NULL);
+    zs->fp = fp;
+    // 16 + window bits: gzip header & trailer
+    if (inflateInit2(&zs->z, 16 + MAX_WBITS) != Z_OK) {
+        free(zs);
+        return NULL;
+    }
+    if ( (in = fopencookie(zs, "r", io)) == NULL) {
+        inflateEnd(&zs->z);
+        free(zs);
+        return NULL;
+    }
+    *how = GP_GZIP;
+    return in;
+}
+
+
+/*  Give a stream that writes to fp compressed as how.
+    Returns:    fp itself for GP_PLAIN, a new stream to be closed with fclose
+                (which finishes the compressed stream but leaves fp open)
+                otherwise, or NULL on error  */
+FILE *openGpOutput( FILE *const fp, const GpCompression how ) {
+
+    cookie_io_functions_t io = { NULL, writeGpZStream, NULL, closeGpZStream };
+    GpZStream *zs;
+    FILE *out;
+
+    if (how == GP_PLAIN)
+        return fp;
+
+    zs = calloc(1, sizeof(GpZStream));
+    assert(zs != NULL);
+    zs->fp = fp;
+    zs->writing = true;
+    if (deflateInit2(&zs->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS,
+                     8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(zs);
+        return NULL;
+    }
+    if ( (out = fopencookie(zs, "w", io)) == NULL) {
+        deflateEnd(&zs->z);
+        free(zs);
+        return NULL;
+    }
+    return out;
+}
+
+
+void freep(void **p) {
+    if (p == NULL || *p == NULL)
+        return;
+    void *t = *p;
+    *p = NULL;
+    free(t);
+}
+
+void freeGpRoutes(GpFile *filep) {
+
+    if (filep->route == NULL)
+        return;
+
+    for (int i = 0; i < filep->nroutes; i++) {
+        freep((void **)&(*(filep->route + i))->comment);
+        freep((void **)(filep->route + i));
+    }
+    freep((void **)&filep->route);
+}
+
+
+void freeGpWaypts(GpFile *filep) {
+
+    if (filep->waypt == NULL)
+        return;
+
+    for (int i = 0; i < filep->nwaypts; i++) {
+        freep((void **)&(filep->waypt + i)->ID);
+        freep((void **)&(filep->waypt + i)->symbol);
+        freep((void **)&(filep->waypt + i)->comment);
+    }
+    freep((void **)&filep->waypt);
+}
+
+
+void freeGpTrkpts(GpFile *filep) {
+
+    if (filep->trkpt == NULL)
+        return;
+
+    for (int i = 0; i < filep->ntrkpts; i++)
+        freep((void **)&(filep->trkpt + i)->comment);
+
+    freep((void **)&filep->trkpt);
+}
+
+
+void freeGpFile( GpFile *filep ) {
+
+    if (filep == NULL)
+        return;
+
+    freep((void **)&filep->dateFormat);
+    freeGpWaypts(filep);
+    freeGpRoutes(filep);
+    freeGpTrkpts(filep);   
+}
+
+
+GpError scanGpWaypt( const char *buff, const char *fieldDef, GpWaypt *wp ) {
+
+    int n_fields = str_count_toks(fieldDef, " \t") - 1;
+    GpFieldHeader head[n_fields];
+    char fields[n_fields][MAX_FIELD_LENGTH];
+    char *id = NULL, *lat = NULL, *lon = NULL;
+    char *symbol = NULL, *comment = NULL;
+    GpError err = OK;
     
-    GPRINTLN("H  COORDINATE SYSTEM\n");
-    GPRINTLN("U  LAT LON DEG\n");
+    wp->textChoice = 'I';
+    wp->textPlace = 2;
+    
+    if (strspn(buff+1, SPACE) == strlen(buff+1))
+        return FIELD;
+    
+    PROF(GP_PROF_FIELDDEF, err = parseGpFieldDef(fieldDef, head));
+    if (err != OK)
+        return err;
+
+    PROF(GP_PROF_SPLIT, err = parseGpLine(buff, fields, head, n_fields));
+    if (err != OK)
+        return err;
+    
+    for (int i = 0; i < n_fields; i++) {
+        switch(head[i].type) {
+            case ID:
+                id = fields[i];
+                break;
+            case LAT:
+                lat = fields[i];
+                break;
+            case LON:
+                lon = fields[i];
+                break;
+            case ALT:
+                break;
+            case SYM:
+                symbol = fields[i];
+                break;
+            case TXCHO:
+                if (chrset(*fields[i], "-IC&+^") == true)
+                    wp->textChoice = *fields[i];
+                else
+                    return VALUE;
+                break;
+            case TXPLA:
+                for (int j = 0; j <= 8; j++) {
+                    char textPlace[][3] = { "N","NE","E","SE",
+                                             "S","SW","W","NW" };
+                    if (j == 8) {
+                        return VALUE;
+                    }
+                    else if (strcmp(textPlace[j],fields[i]) == 0) {
+                        wp->textPlace = j;
+                        break;
+                    }
+                }
+                break;
+            case COMMENT:
+                comment = fields[i];
+                break;
+            default:
+                return FIELD;
+        }
+    }
+
+    if ( (id == NULL) || (lat == NULL) || (lon == NULL) )
+        return FIELD;
+    
+    PROF(GP_PROF_COORDS, err = parseGpCoords(lat, lon, &(wp->coord)));
+    if (err != OK)
+        return VALUE;
+
+    // parsing succeeded, allocate memory for id, symbol and comment
+    PROF(GP_PROF_ALLOC,
+         wp->ID = newstr(id);
+         wp->symbol = ( symbol == NULL ? newstr("") : newstr(symbol) );
+         wp->comment = ( comment == NULL ? newstr("") : newstr(comment) ));
+    PROF_ALLOC(strlen(wp->ID) + 1);
+    PROF_ALLOC(strlen(wp->symbol) + 1);
+    PROF_ALLOC(strlen(wp->comment) + 1);
+
+    return OK;
+}
+
+
+GpError scanGpRoute( const char *buff, GpRoute *rp ) {
+
+    char *comment;
+    
+    if (strspn(buff+1, SPACE) == strlen(buff+1))
+        return FIELD;
+    
+    rp->number = (int)strtol(buff+1, &comment, 10);
+    if ( (rp->number < 0) || ((buff+1) == comment) )
+        return VALUE;
+    else if ( (*comment != '\0') && (chrset(*comment, SPACE) == false) )
+        return VALUE;
+
+    comment += strspn(comment, SPACE);
+    PROF(GP_PROF_ALLOC, rp->comment = newstr(comment));
+    PROF_ALLOC(strlen(comment) + 1);
+    rp->npoints = 0;
+    return OK;
+}
+
+
+GpError scanGpLeg(const char *buff, const char *fieldDef, const GpWaypt *wp,
+                  const int nwp, GpRoute *rp) {
+
+    int n_fields = str_count_toks(fieldDef, SPACE) - 1;
+    char *id = NULL;
+    GpFieldHeader head[n_fields];    
+    char fields[n_fields][MAX_FIELD_LENGTH];
+    GpError err = OK;
+
+    if (strspn(buff+1, SPACE) == strlen(buff+1))
+        return FIELD;
+
+    PROF(GP_PROF_FIELDDEF, err = parseGpFieldDef(fieldDef, head));
+    if (err != OK)
+        return err;
+
+    PROF(GP_PROF_SPLIT, err = parseGpLine(buff, fields, head, n_fields));
+    if (err != OK)
+        return err;
+
+    for (int i = 0; i < n_fields; i++) {
+        if (head[i].type == ID) {
+            id = fields[i];
+            break;
+        }
+    }
+    
+    if (id == NULL)
+        return FIELD;
+
+    err = UNKWPT;
+    PROF(GP_PROF_LEGS,
+        for (int i = 0; i < nwp; i++) {
+            if (strcmp((wp + i)->ID, id) == 0) {
+                rp->leg[rp->npoints - 1] = i;
+                err = OK;
+                break;
+            }
+        });
+
+    return err;
+}
+
+
+GpError scanGpTrkpt( const char *buff, const char *fieldDef,
+                    const char *dateFormat, GpTrkpt *tp ) {
+
+    int n_fields = str_count_toks(fieldDef, SPACE) - 1;
+    GpFieldHeader head[n_fields];
+    char fields[n_fields][MAX_FIELD_LENGTH];
+
+    char *lat = NULL, *lon = NULL, *comment = NULL;
+    char dateBuf[MAX_FIELD_LENGTH] = "";
+    char dateFormBuf[MAX_FIELD_LENGTH] = "";
+    int validFields = 0;
+    struct tm tm;
+    GpError err = OK;
+
+    memset(&tm,0,sizeof(struct tm));
+    memset(tp,0,sizeof(GpTrkpt));
+    tp->alt = NAN;
+
+    PROF(GP_PROF_FIELDDEF, err = parseGpFieldDef(fieldDef, head));
+    if (err != OK)
+        return err;
+
+    PROF(GP_PROF_SPLIT, err = parseGpLine(buff, fields, head, n_fields));
+    if (err != OK)
+        return err;
+
+    for (int i = 0; i < n_fields; i++) {
+        GpFieldType t = head[i].type;
+
+        if (t == LAT) {
+            lat = fields[i];
+        }
+        else if (t == LON) {
+            lon = fields[i];
+        }
+        else if (t == ALT) {
+            char *p;
+            tp->alt = strtod(fields[i], &p);
+            if (p == fields[i] || *p != '\0')
+                tp->alt = NAN;
+            continue;
+        }
+        else if (t == DATE) {
+            strcat(dateBuf, fields[i]);
+            strcat(dateFormBuf, dateFormat);
+        }
+        else if (t == TIME) {
+            strcat(dateBuf, fields[i]);
+            strcat(dateFormBuf, " %H:%M:%S ");
+        }
+        else if (t == SEGFLAG) {
+            if (strcmp(fields[i],"0") == 0) {
+                tp->segFlag = false;
+            }
+            else {
+                comment = fields[i];
+                tp->segFlag = true;
+                break;
+            }
+        }
+        else if (t == SECONDS) {
+            char *p;
+            tp->duration = strtol(fields[i], &p, 10);
+            if ( (p == NULL) || (*p != '\0') )
+                return VALUE;
+        }
+        else if (t == DUR) {
+            if (parseGpDuration(fields[i], &(tp->duration)) != OK)
+                return VALUE;
+        }
+        else if (t == DIST) {
+            char *p = NULL;
+            tp->dist = strtod(fields[i], &p);
+            if (*p != '\0')
+                return VALUE;
+        }
+        else if (t == SPEED) {
+            char *p = NULL;
+            tp->speed = (float)strtod(fields[i], &p);
+            if (*p != '\0')
+                return VALUE;
+        }
+        else {
+            return FIELD;
+        }
+        validFields++;
+    }
+    
+    if ( (tp->segFlag == false) && (validFields < 8) )
+        return FIELD;
+
+    if ( (lat != NULL) && (lon != NULL ) ) {
+        PROF(GP_PROF_COORDS, err = parseGpCoords(lat, lon, &(tp->coord)));
+        if (err != OK)
+            return VALUE;
+    }
+
+    char *p;
+    PROF(GP_PROF_TIMES, p = strptime(dateBuf, dateFormBuf, &tm));
+    if ( (p == NULL) || (*p != '\0') ) {
+        return VALUE;
+    }
+    else {
+        tm.tm_isdst = -1;
+        PROF(GP_PROF_TIMES, tp->dateTime = mktime(&tm));
+        if (tp->dateTime == -1)
+            return VALUE;
+    }
+    if (comment != NULL) {
+        PROF(GP_PROF_ALLOC, tp->comment = newstr(comment));
+        PROF_ALLOC(strlen(comment) + 1);
+    }
+    
+    return OK;
+}
+
+
+int getGpTracks( const GpFile *filep, GpTrack **tp ) {
+
+    int n_tracks = 0;
+    *tp = NULL;
+    GpCoord NE = {-91, -181}, SW = {91, 181};
+    
+    for (int i = 0; i < filep->ntrkpts; i++) {
+        GpTrkpt *cur_tp = filep->trkpt + i;
+        if (cur_tp->segFlag == false || n_tracks == 0) {
+            if ((cur_tp->coord).lat > NE.lat)
+                NE.lat = (cur_tp->coord).lat;
+            if ((cur_tp->coord).lat < SW.lat)
+                SW.lat = (cur_tp->coord).lat;
+            if ((cur_tp->coord).lon > NE.lon)
+                NE.lon = ((cur_tp)->coord).lon;
+            if ((cur_tp->coord).lon < SW.lon)
+                SW.lon = ((cur_tp)->coord).lon;
+        }
+        // end of segment
+        if ( ( (cur_tp->segFlag == true) && (n_tracks > 0) )
+            || (i == (filep->ntrkpts - 1))) {
+            GpTrkpt *prev_tp = filep->trkpt + i;
+            if (cur_tp->segFlag == true)
+                prev_tp--;
+            (*tp + n_tracks - 1)->endTrk = prev_tp->dateTime;
+            (*tp + n_tracks - 1)->duration = prev_tp->duration;
+            (*tp + n_tracks - 1)->dist = prev_tp->dist;
+            (*tp + n_tracks - 1)->speed = prev_tp->dist / prev_tp->duration;
+            if (filep->unitTime == 'H')
+                (*tp + n_tracks - 1)->speed *= 3600;
+            ((*tp + n_tracks - 1)->meanCoord).lat = (NE.lat + SW.lat) / 2;
+            ((*tp + n_tracks - 1)->meanCoord).lon = (NE.lon + SW.lon) / 2;
+            (*tp + n_tracks - 1)->NEcorner = NE;
+            (*tp + n_tracks - 1)->SWcorner = SW;
+        }
+        // start of new segment
+        if (cur_tp->segFlag == true) {
+            *tp = realloc(*tp, ((n_tracks + 1) * sizeof (GpTrack)));
+            assert(*tp != NULL);
+            (*tp + n_tracks)->seqno = i+1;
+            (*tp + n_tracks)->startTrk = cur_tp->dateTime;
+            NE = SW = cur_tp->coord;
+            n_tracks++;
+            // last trackpoint alone in its segment
+            if (i == (filep->ntrkpts - 1)) {
+                (*tp + n_tracks - 1)->endTrk = cur_tp->dateTime;
+                (*tp + n_tracks - 1)->duration = 0;
+                (*tp + n_tracks - 1)->dist = 0;
+                (*tp + n_tracks - 1)->speed = 0;
+                (*tp + n_tracks - 1)->meanCoord = cur_tp->coord;
+                (*tp + n_tracks - 1)->NEcorner = NE;
+                (*tp + n_tracks - 1)->SWcorner = SW;
+            }
+        }
+        // check NE and SW bounds
+        else {
+
+        }
+    }    
+    return n_tracks;
+}
+
+
+/*  Scramble the bits of a 64-bit value (splitmix64 finalizer)  */
+static uint64_t mixGpHash( uint64_t x ) {
+
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+
+/*  Hash the content of each track segment, so that the same track read from
+    different files hashes the same.  Each trackpoint contributes its position
+    quantized to GP_HASHQUANT deg. and its time in whole seconds, combined as
+    a polynomial rolling hash over the segment in order; comments and the
+    derived fields (dist, speed, duration) are left out.  Only segments
+    matching point for point hash the same: one that overlaps another in
+    part, or has a point more or less, does not.
+    Paramaters:
+        filep - file whose trackpoints are hashed
+        hash - set to a malloc'd array of one hash per segment, in file order
+               (NULL if there are no trackpoints); the first trackpoint
+               always starts one, so any before the first segFlag hash as a
+               segment that getGpTracks() leaves out
+    Returns: no. of segments hashed  */
+int getGpTrackHashes( const GpFile *filep, uint64_t **hash ) {
+
+    int n = 0;
+
+    *hash = NULL;
+    for (int i = 0; i < filep->ntrkpts; i++)
+        if (i == 0 || filep->trkpt[i].segFlag == true)
+            n++;
+    if (n == 0)
+        return 0;
+    *hash = malloc(n * sizeof(uint64_t));
+    assert(*hash != NULL);
+
+    int t = -1;
+    uint64_t h = 0, len = 0;
+    for (int i = 0; i < filep->ntrkpts; i++) {
+        const GpTrkpt *tp = filep->trkpt + i;
+        if (i == 0 || tp->segFlag == true) {
+            if (t >= 0)
+                (*hash)[t] = mixGpHash(h ^ len);
+            t++;
+            h = 0;
+            len = 0;
+        }
+        uint64_t k = mixGpHash(llround(tp->coord.lat / GP_HASHQUANT));
+        k ^= mixGpHash(llround(tp->coord.lon / GP_HASHQUANT)
+                       + 0x9e3779b97f4a7c15ULL);
+        k ^= mixGpHash((uint64_t)tp->dateTime + 0x3c6ef372fe94f82aULL);
+        h = (h + k) * 0x100000001b3ULL;
+        len++;
+    }
+    (*hash)[t] = mixGpHash(h ^ len);
+    return n;
+}
+
+
+/*  Return the factor that converts kilometres into unitHorz units, or 1 for an
+    unrecognized unit (kilometres)  */
+double getGpUnitFactor( const char unitHorz ) {
+
+    switch (unitHorz) {
+        case 'M':
+            return 1000;
+        case 'F':
+            return 1000 / 0.3048;
+        case 'N':
+            return 1 / 1.852;
+        case 'S':
+            return 1 / 1.609344;
+        default:
+            return 1;
+    }
+}
+
+
+/*  Haversine distance between two points given the sine of half their
+    latitude and longitude differences and the cosine of each latitude    */
+static double haversine(double sdlat, double sdlon, double clat1,
+                        double clat2) {
+
+    double a = sdlat * sdlat + clat1 * clat2 * sdlon * sdlon;
+    // rounding can push a just past 1 for near-antipodal points
+    if (a > 1)
+        a = 1;
+    else if (a < 0)
+        a = 0;
+    return 2 * atan2(sqrt(a), sqrt(1 - a)) * GP_EARTH_RADIUS;
+}
+
+
+/*  Great-circle distance in km. between from and to    */
+double getGpDistance( const GpCoord from, const GpCoord to ) {
+
+    return haversine(sin(RAD(to.lat - from.lat) / 2),
+                     sin(RAD(to.lon - from.lon) / 2),
+                     cos(RAD(from.lat)), cos(RAD(to.lat)));
+}
+
+
+/*  Compute the great-circle distance in km. from each from[i] to to[i], storing
+    the results in dist.
+    Paramaters: from and to are arrays of n coordinates
+                dist is an allocated array of n doubles  */
+void getGpDistances( const GpCoord *from, const GpCoord *to, const int n,
+                     double *dist ) {
+
+    for (int i = 0; i < n; i++)
+        dist[i] = getGpDistance(from[i], to[i]);
+}
+
+
+/*  Compute the great-circle distance in km. of each leg of the path through
+    coord, storing the distance from coord[i-1] to coord[i] in dist[i] and 0 in
+    dist[0]. The cosine of each latitude is only computed once.
+    Paramaters: coord is an array of n coordinates
+                dist is an allocated array of n doubles  */
+void getGpLegDists( const GpCoord *coord, const int n, double *dist ) {
+
+    double clat;
+
+    if (n <= 0)
+        return;
+
+    dist[0] = 0;
+    clat = cos(RAD(coord[0].lat));
+    for (int i = 1; i < n; i++) {
+        double cnext = cos(RAD(coord[i].lat));
+        dist[i] = haversine(sin(RAD(coord[i].lat - coord[i-1].lat) / 2),
+                            sin(RAD(coord[i].lon - coord[i-1].lon) / 2),
+                            clat, cnext);
+        clat = cnext;
+    }
+}
+
+
+/*  Distance in km. from p to the line segment from a to b, on a plane tangent
+    to the earth at a   */
+static double segmentDist(GpCoord p, GpCoord a, GpCoord b) {
+
+    double kx = GP_EARTH_RADIUS * RAD(1) * cos(RAD(a.lat));
+    double ky = GP_EARTH_RADIUS * RAD(1);
+    double bx = (b.lon - a.lon) * kx, by = (b.lat - a.lat) * ky;
+    double px = (p.lon - a.lon) * kx, py = (p.lat - a.lat) * ky;
+    double len2 = bx * bx + by * by;
+    double t = (len2 > 0) ? (px * bx + py * by) / len2 : 0;
+
+    if (t < 0)
+        t = 0;
+    else if (t > 1)
+        t = 1;
+    return hypot(px - t * bx, py - t * by);
+}
+
+
+/*  Mark the points of the path through coord that must be kept so that no
+    discarded point is farther than tolerance from the simplified path
+    (Douglas-Peucker). The first and last points are always kept.
+    Paramaters: coord is an array of n coordinates
+                tolerance is the maximum deviation in km.
+                keep is an allocated array of n flags to store the results
+    Returns:    the no. of points kept  */
+int simplifyGpPath( const GpCoord *coord, const int n, const double tolerance,
+                    _Bool *keep ) {
+
+    int nkept = 0, top = 0;
+    int (*stack)[2];
+
+    if (n <= 0)
+        return 0;
+    for (int i = 0; i < n; i++)
+        keep[i] = false;
+    keep[0] = keep[n-1] = true;
+    if (n <= 2)
+        return n;
+
+    // ranges still to be simplified, at most one per point
+    stack = malloc(n * sizeof(*stack));
+    assert(stack != NULL);
+    stack[top][0] = 0;
+    stack[top++][1] = n - 1;
+
+    while (top > 0) {
+        int first = stack[--top][0], last = stack[top][1];
+        int farthest = -1;
+        double maxDist = tolerance;
+
+        for (int i = first + 1; i < last; i++) {
+            double d = segmentDist(coord[i], coord[first], coord[last]);
+            if (d > maxDist) {
+                maxDist = d;
+                farthest = i;
+            }
+        }
+        if (farthest == -1)
+            continue;
+        keep[farthest] = true;
+        if (farthest - first > 1) {
+            stack[top][0] = first;
+            stack[top++][1] = farthest;
+        }
+        if (last - farthest > 1) {
+            stack[top][0] = farthest;
+            stack[top++][1] = last;
+        }
+    }
+    free(stack);
+
+    for (int i = 0; i < n; i++)
+        nkept += keep[i];
+    return nkept;
+}
+
+
+/*  Simplify each track segment of filep separately with simplifyGpPath().
+    Paramaters: tolerance is the maximum deviation in filep's unitHorz
+                keep is an allocated array of filep->ntrkpts flags
+    Returns:    the no. of trackpoints kept */
+int simplifyGpTrkpts( const GpFile *filep, const double tolerance,
+                      _Bool *keep ) {
+
+    GpCoord *coord = malloc((filep->ntrkpts + 1) * sizeof(GpCoord));
+    double km = tolerance / getGpUnitFactor(filep->unitHorz);
+    int nkept = 0;
+
+    assert(coord != NULL);
+    for (int i = 0; i < filep->ntrkpts; i++)
+        coord[i] = filep->trkpt[i].coord;
+
+    for (int start = 0, end; start < filep->ntrkpts; start = end) {
+        for (end = start + 1; end < filep->ntrkpts
+                              && filep->trkpt[end].segFlag == false; end++)
+            ;
+        nkept += simplifyGpPath(coord + start, end - start, km, keep + start);
+    }
+    free(coord);
+    return nkept;
+}
+
+
+/*  Order index entries by cell, then waypoints before trackpoints, then by
+    subscript   */
+static int compGpIndexEntry(const void *e1, const void *e2) {
+
+    const GpIndexEntry *a = e1, *b = e2;
+    if (a->cell != b->cell)
+        return (a->cell < b->cell) ? -1 : 1;
+    if (a->isTrkpt != b->isTrkpt)
+        return a->isTrkpt - b->isTrkpt;
+    return a->index - b->index;
+}
+
+
+/*  Order matches by distance, then waypoints before trackpoints, then by
+    subscript   */
+static int compGpMatch(const void *m1, const void *m2) {
+
+    const GpMatch *a = m1, *b = m2;
+    if (a->dist != b->dist)
+        return (a->dist < b->dist) ? -1 : 1;
+    if (a->isTrkpt != b->isTrkpt)
+        return a->isTrkpt - b->isTrkpt;
+    return a->index - b->index;
+}
+
+
+/*  Grid row or column of a latitude or longitude, clamped to the grid   */
+static long gridLine(double deg, double min, double cellSize, long nlines) {
+
+    long line = (long)floor((deg - min) / cellSize);
+    if (line < 0)
+        return 0;
+    if (line >= nlines)
+        return nlines - 1;
+    return line;
+}
+
+
+static long gpCell(const GpIndex *ip, GpCoord coord) {
+
+    long nrows = (long)ceil(180 / ip->cellSize) + 1;
+    return gridLine(coord.lat, -90, ip->cellSize, nrows) * ip->ncols
+           + gridLine(coord.lon, -180, ip->cellSize, ip->ncols);
+}
+
+
+/*  Build a grid index of cellSize degree cells over every waypoint and
+    trackpoint in filep. ip must be freed with freeGpIndex().
+    Paramaters: filep is the file to index, which must not be modified while
+                the index is in use
+                cellSize is the width of a cell, or <= 0 for GP_CELLSIZE
+                ip is the index to initialize   */
+void buildGpIndex( const GpFile *filep, const double cellSize, GpIndex *ip ) {
+
+    ip->cellSize = (cellSize > 0) ? cellSize : GP_CELLSIZE;
+    ip->ncols = (long)ceil(360 / ip->cellSize) + 1;
+    ip->nentries = filep->nwaypts + filep->ntrkpts;
+    ip->entry = malloc((ip->nentries + 1) * sizeof(GpIndexEntry));
+    assert(ip->entry != NULL);
+
+    for (int i = 0; i < filep->nwaypts; i++) {
+        GpIndexEntry e = { 0, filep->waypt[i].coord, false, i };
+        e.cell = gpCell(ip, e.coord);
+        ip->entry[i] = e;
+    }
+    for (int i = 0; i < filep->ntrkpts; i++) {
+        GpIndexEntry e = { 0, filep->trkpt[i].coord, true, i };
+        e.cell = gpCell(ip, e.coord);
+        ip->entry[filep->nwaypts + i] = e;
+    }
+    qsort(ip->entry, ip->nentries, sizeof(GpIndexEntry), compGpIndexEntry);
+}
+
+
+/*  Subscript of the first entry in ip whose cell is >= cell    */
+static int lowerGpCell(const GpIndex *ip, long cell) {
+
+    int lo = 0, hi = ip->nentries;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (ip->entry[mid].cell < cell)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+
+/*  Append every entry inside the box [SW, NE] to *mp, which holds *n of *size
+    allocated matches. SW.lon may be greater than NE.lon for a box that
+    crosses the 180th meridian. When centre is not NULL only entries within
+    dist km. of centre are appended  */
+static void scanGpBox(const GpIndex *ip, GpCoord SW, GpCoord NE,
+                      const GpCoord *centre, double dist, GpMatch **mp,
+                      int *n, int *size) {
+
+    long nrows = (long)ceil(180 / ip->cellSize) + 1;
+    long row0 = gridLine(SW.lat, -90, ip->cellSize, nrows);
+    long row1 = gridLine(NE.lat, -90, ip->cellSize, nrows);
+
+    if (SW.lon > NE.lon) {
+        GpCoord east = { NE.lat, 180 }, west = { SW.lat, -180 };
+        scanGpBox(ip, SW, east, centre, dist, mp, n, size);
+        scanGpBox(ip, west, NE, centre, dist, mp, n, size);
+        return;
+    }
+
+    long col0 = gridLine(SW.lon, -180, ip->cellSize, ip->ncols);
+    long col1 = gridLine(NE.lon, -180, ip->cellSize, ip->ncols);
+
+    for (long row = row0; row <= row1; row++) {
+        long last = row * ip->ncols + col1;
+        for (int i = lowerGpCell(ip, row * ip->ncols + col0);
+             i < ip->nentries && ip->entry[i].cell <= last; i++) {
+            GpIndexEntry *e = ip->entry + i;
+            GpMatch m = { e->isTrkpt, e->index, 0 };
+
+            if (e->coord.lat < SW.lat || e->coord.lat > NE.lat
+                || e->coord.lon < SW.lon || e->coord.lon > NE.lon)
+                continue;
+            if (centre != NULL
+                && (m.dist = getGpDistance(*centre, e->coord)) > dist)
+                continue;
+            if (*n == *size) {
+                *size = (*size == 0) ? 16 : *size * 2;
+                *mp = realloc(*mp, *size * sizeof(GpMatch));
+                assert(*mp != NULL);
+            }
+            (*mp)[(*n)++] = m;
+        }
+    }
+}
+
+
+/*  Find every indexed point inside the box with corners SW and NE. A box
+    that crosses the 180th meridian has SW.lon > NE.lon.
+    Paramaters: ip is an index built by buildGpIndex()
+                mp will point to an allocated array of matches, ordered by
+                cell, or NULL if there are none
+    Returns:    the no. of matches    */
+int queryGpBox( const GpIndex *ip, const GpCoord SW, const GpCoord NE,
+                GpMatch **mp ) {
+
+    int n = 0, size = 0;
+    *mp = NULL;
+    scanGpBox(ip, SW, NE, NULL, 0, mp, &n, &size);
+    return n;
+}
+
+
+/*  Find every indexed point within dist km. of centre, only examining the
+    cells covering the bounding box of the circle.
+    Paramaters: ip is an index built by buildGpIndex()
+                mp will point to an allocated array of matches, ordered by
+                distance from centre, or NULL if there are none
+    Returns:    the no. of matches    */
+int queryGpRadius( const GpIndex *ip, const GpCoord centre, const double dist,
+                   GpMatch **mp ) {
+
+    int n = 0, size = 0;
+    double dlat = dist / GP_EARTH_RADIUS * 180 / M_PI;
+    GpCoord SW = { centre.lat - dlat, -180 }, NE = { centre.lat + dlat, 180 };
+
+    *mp = NULL;
+    if (dist < 0)
+        return 0;
+
+    // the circle covers every longitude if it reaches a pole
+    if (NE.lat < 90 && SW.lat > -90) {
+        double dlon = asin(fmin(1, sin(dist / GP_EARTH_RADIUS)
+                                   / cos(RAD(centre.lat)))) * 180 / M_PI;
+        SW.lon = centre.lon - dlon;
+        NE.lon = centre.lon + dlon;
+        if (SW.lon < -180)
+            SW.lon += 360;
+        if (NE.lon > 180)
+            NE.lon -= 360;
+    }
+    scanGpBox(ip, SW, NE, &centre, dist, mp, &n, &size);
+    qsort(*mp, n, sizeof(GpMatch), compGpMatch);
+    return n;
+}
+
+
+void freeGpIndex( GpIndex *ip ) {
+
+    if (ip == NULL)
+        return;
+    free(ip->entry);
+    ip->entry = NULL;
+    ip->nentries = 0;
+}
+
+
+static int writeGpRecords( FILE *const gpf, const GpFile *filep ) {
+
+    char buf[BUFSIZE] = "";
+    int COUNT = 1;
+    int id_len = 0, sym_len = 0, com_len = 0;
+
+    // file header, I, S, M and U lines
+    GPRINTLN("H  SOFTWARE NAME & VERSION\n");
+    GPRINTLN("I  GPSU 4.20 01 FREEWARE VERSION\n");
+    GPRINTLN("\n");
+
+    sscanf(filep->dateFormat, "%%%*c/%%%c/%%%c", buf, buf + 1);
+    GPRINTLN("S DateFormat=dd/%s/%s\n", (buf[0] == 'm') ? "mm" : "mmm",
+            (buf[1] == 'y') ? "yy" : "yyyy");
+    GPRINTLN("S Timezone=%+d:00\n", filep->timeZone);
+    GPRINTLN("S Units=%c\n", filep->unitHorz);
+    GPRINTLN("\n");
+    
+    GPRINTLN("H R DATUM\n");
+    GPRINTLN("M E            WGS 84 100  0.0000000E+00  0.0000000E+00 0 0 0\n");
+    GPRINTLN("\n");
+    
+    GPRINTLN("H  COORDINATE SYSTEM\n");
+    GPRINTLN("U  LAT LON DEG\n");
+
+    // write waypoints, if any
+    if (filep->nwaypts > 0) {
+        GPRINTLN("\n");
+        // determine waypoint F line column sizes
+        for (int i = 0; i < filep->nwaypts; i++) {
+            if (strlen(filep->waypt[i].ID) > id_len)
+                id_len = strlen(filep->waypt[i].ID);
+            if (strlen(filep->waypt[i].symbol) > sym_len)
+                sym_len = strlen(filep->waypt[i].symbol);
+            if (strlen(filep->waypt[i].comment) > com_len)
+                com_len = strlen(filep->waypt[i].comment);
+        }
+        // columns at least as wide as their F line headings
+        id_len = MAX(id_len, (int)strlen("ID"));
+        if (sym_len > 0)
+            sym_len = MAX(sym_len, (int)strlen("Symbol"));
+
+        // print waypoint F line
+        GPRINT("F ID");
+        for (int i = strlen("ID"); i < id_len; i++)
+            GPRINT("-");
+        GPRINT(" %-*s %-*s T O  ", LATLEN, "Latitude", LONLEN, "Longitude");
+        if (sym_len > 0) {
+            GPRINT("Symbol");
+            for (int i = strlen("Symbol"); i < sym_len; i++)
+                GPRINT("-");
+        }
+        if (com_len > 0)
+            GPRINT(" Comment");
+        GPRINTLN("\n");
+
+        // print waypoints
+        for (int i = 0; i < filep->nwaypts; i++) {
+            char textPlace[][3] ={ "N", "NE", "E", "SE", "S", "SW", "W", "NW" };
+            GpWaypt wp = filep->waypt[i];
+            GPRINT("W %-*s ", id_len, wp.ID);
+            
+            coordToStr(buf, wp.coord);
+            GPRINT("%s %c %-2s", buf, wp.textChoice, textPlace[wp.textPlace]);
+            
+            if (sym_len > 0)
+                GPRINT(" %-*s", sym_len, wp.symbol);
+
+            if (com_len > 0)
+                GPRINT(" %s", wp.comment);
+            GPRINTLN("\n");
+        }    
+    }
+    // write routes, if any
+    for (int i = 0; i < filep->nroutes; i++) {
+        GpRoute *rp = *(filep->route + i);
+        id_len = 0;
+        GPRINTLN("\n");
+        // determine routes F line column sizes
+        for (int j = 0; j < rp->npoints; j++) {
+            if (strlen(filep->waypt[rp->leg[j]].ID) > id_len)
+                id_len = strlen(filep->waypt[rp->leg[j]].ID);
+        }
+        // print R line
+        GPRINTLN("R %.2d %s\n", rp->number, rp->comment);
+        // print routes F line
+        GPRINT("F ID");
+        for (int i = strlen("ID"); i < id_len; i++)
+            GPRINT("-");
+
+        GPRINTLN("\n");
+        
+        // print route waypoints
+        for (int j = 0; j < rp->npoints; j++)
+            GPRINTLN("W %-*s\n", id_len, filep->waypt[rp->leg[j]].ID);
+    }
+
+    // write track info and trackpoints, if any
+    if (filep->ntrkpts > 0) {
+        GpTrack *tp;
+        int n_tracks = getGpTracks(filep, &tp);
+        char dist_units[][8] = {
+            ['M'] = "m", ['K'] = "km", ['F'] = "ft", ['N'] = "nm",
+            ['S'] = "miles" 
+        };
+        char speed_units[][8] = {
+            ['M'] = "m/s", ['K'] = "km/h", ['F'] = "ft/s", ['N'] = "knots",
+            ['S'] = "mph"
+        };
+        GPRINTLN("\n");
+        
+        // determine track header column sizes
+        struct tm timebuf;
+        int dist_len = strlen(dist_units[(int)filep->unitHorz]);
+        int speed_len = strlen(speed_units[(int)filep->unitHorz]);
+        localtime_r(&filep->trkpt->dateTime, &timebuf);
+        int date_len = strftime(buf, MAX_FIELD_LENGTH, filep->dateFormat, &timebuf);
+
+        for (int i = 0; i < n_tracks; i++) {
+            sprintf(buf, "%lf", (tp + i)->dist);
+            if (strlen(buf) > dist_len)
+                dist_len = strlen(buf);
+            sprintf(buf, "%f", (tp + i)->speed);
+            if (strlen(buf) > speed_len)
+                speed_len = strlen(buf);
+        }
+        
+        // print track header column definitions
+        GPRINTLN("H    Track    Pnts. %-*s Time     StopTime Duration %*s %*s\n",
+                date_len, "Date", dist_len, dist_units[(int)filep->unitHorz],
+                speed_len, speed_units[(int)filep->unitHorz]);
+        
+        // print track H line information
+        for (int i = 0; i < n_tracks; i++) {
+            int npts = (i < n_tracks - 1) 
+                       ? (tp+i+1)->seqno - (tp+i)->seqno - 1
+                       : filep->ntrkpts - (tp+i)->seqno;
+
+            if (localtime_r(&(tp + i)->startTrk, &timebuf) == NULL
+                || strftime(buf, date_len + 1, filep->dateFormat,
+                            &timebuf) == 0
+                || strftime(buf + strlen(buf), TIMELEN + 2, " %X",
+                            &timebuf) == 0
+                || localtime_r(&(tp + i)->endTrk, &timebuf) == NULL
+                || strftime(buf + strlen(buf), TIMELEN + 2, " %X",
+                            &timebuf) == 0) {
+                freep((void **)&tp);
+                return 0;
+            }
+            GPRINTLN("H %8d %8d %s %02d:%02d:%02d %*lf %*f\n",
+                    (tp+i)->seqno, npts, buf, (int)(tp+i)->duration / 3600 % 60,
+                    (int)(tp+i)->duration / 60 % 60, (int)(tp+i)->duration % 60,
+                    dist_len, (tp+i)->dist, speed_len, (tp+i)->speed);
+        }        
+        GPRINTLN("\n");
+        freep((void **)&tp);
+
+        // determine trackpoint F line column sizes
+        dist_len = strlen(dist_units[(int)filep->unitHorz]);
+        speed_len = strlen(speed_units[(int)filep->unitHorz]);
+        int alt_len = 0;    // no Alt field unless some altitude is known
+        for (int i = 0; i < filep->ntrkpts; i++) {
+            sprintf(buf, "%lf", filep->trkpt[i].dist);
+            if (strlen(buf) > dist_len)
+                dist_len = strlen(buf);
+            sprintf(buf, "%f", filep->trkpt[i].speed);
+            if (strlen(buf) > speed_len)
+                speed_len = strlen(buf);
+            if (isnan(filep->trkpt[i].alt) == false) {
+                sprintf(buf, "%.1f", filep->trkpt[i].alt);
+                if (alt_len < strlen("Alt"))
+                    alt_len = strlen("Alt");
+                if (strlen(buf) > alt_len)
+                    alt_len = strlen(buf);
+            }
+        }
+
+        // print trackpoint F line
+        GPRINT("F %-*s %-*s", LATLEN, "Latitude", LONLEN, "Longitude");
+        if (alt_len > 0)
+            GPRINT(" %-*s", alt_len, "Alt");
+        GPRINTLN(" %-*s %-8s S %-8s %*s %*s\n",
+                date_len, "Date",
+                "Time", "Duration", dist_len, dist_units[(int)filep->unitHorz],
+                speed_len, speed_units[(int)filep->unitHorz]);
+        // print trackpoints
+        for (int i = 0; i < filep->ntrkpts; i++) {
+            GpTrkpt tp = filep->trkpt[i];
+
+            coordToStr(buf, tp.coord);
+            if (alt_len > 0 && isnan(tp.alt) == true)
+                sprintf(buf + strlen(buf), " %*s", alt_len, "-");
+            else if (alt_len > 0)
+                sprintf(buf + strlen(buf), " %*.1f", alt_len, tp.alt);
+            strcat(buf, " ");
+            if ( (localtime_r(&tp.dateTime, &timebuf) == NULL)
+                 || (strftime(buf + strlen(buf), date_len + 1, filep->dateFormat,
+                                &timebuf) == 0)
+                 || (strftime(buf + strlen(buf), TIMELEN + 2, " %X",
+                     &timebuf) == 0) )
+                return 0;
+
+            GPRINT("T %s", buf);
+
+            if (tp.segFlag == true) {
+                GPRINTLN(" 1 %s\n", tp.comment);
+            }
+            else {
+                GPRINTLN(" 0 %02d:%02d:%02d %*lf %*f\n",
+                        (int)tp.duration / 3600 % 60,
+                        (int)tp.duration / 60 % 60, (int)tp.duration % 60,
+                        dist_len, tp.dist, speed_len, tp.speed);
+            }
+        }        
+    }
+    return COUNT;
+}
+
+
+int writeGpFile( FILE *const gpf, const GpFile *filep ) {
+
+    int rv;
+    PROF(GP_PROF_WRITE, rv = writeGpRecords(gpf, filep));
+    return rv;
+}
+
+
+/*  Copy the counters gathered since the program started into prof.
+    Returns:    false if gputil was built without GP_PROFILE, so there are none
+*/
+_Bool getGpProfile( GpProfile *prof ) {
+
+#ifdef GP_PROFILE
+    *prof = gpProfile;
+    return true;
+#else
+    memset(prof, 0, sizeof(GpProfile));
+    return false;
+#endif
+}
+
+
+/*  Write the time and calls for each phase of prof, and its allocations, as a
+    table with the parsing phases indented under the read that includes them.
+    Returns:    0 on a write error, 1 otherwise  */
+int writeGpProfile( FILE *const gpf, const GpProfile *prof ) {
+
+    char *names[GP_PROF_NPHASES] = { "read", "  lines", "  field defs",
+        "  split fields", "  coordinates", "  timestamps", "  allocation",
+        "  leg lookup", "write" };
+    long long other = prof->ns[GP_PROF_READ];
+
+    GPRINT("%-16s %12s %14s\n", "phase", "calls", "ms");
+    for (int i = 0; i < GP_PROF_NPHASES; i++) {
+        if (i > GP_PROF_READ && i < GP_PROF_WRITE)
+            other -= prof->ns[i];
+        if (i == GP_PROF_WRITE && prof->calls[GP_PROF_READ] > 0)
+            GPRINT("%-16s %12s %14.3f\n", "  other", "",
+                   (other > 0 ? other : 0) / 1e6);
+        GPRINT("%-16s %12ld %14.3f\n", names[i], prof->calls[i],
+               prof->ns[i] / 1e6);
+    }
+    GPRINT("allocations %ld, %lld bytes\n", prof->nallocs, prof->allocBytes);
+    return 1;
+}
+
+
+/*  Write one signed value of an encoded polyline inside a JSON string, where
+    '\\' is the only character of the encoding that needs escaping  */
+static void putGpPolyValue(FILE *const gpf, long value) {
+
+    unsigned long v = (value < 0) ? ~((unsigned long)value << 1)
+                                  : (unsigned long)value << 1;
+    do {
+        int c = (int)(((v >= 0x20) ? 0x20 : 0) | (v & 0x1f)) + 63;
+        if (c == '\\')
+            putc('\\', gpf);
+        putc(c, gpf);
+        v >>= 5;
+    } while (v > 0);
+}
+
+
+/*  Write coord as a JSON string holding a Google encoded polyline (5 decimal
+    places, each point a delta from the previous one).
+    Returns:    0 on a write error   */
+int writeGpPolyline( FILE *const gpf, const GpCoord *coord, const int n ) {
+
+    long lat = 0, lon = 0;
+
+    putc('"', gpf);
+    for (int i = 0; i < n; i++) {
+        long nextLat = lround(coord[i].lat * 1e5);
+        long nextLon = lround(coord[i].lon * 1e5);
+        putGpPolyValue(gpf, nextLat - lat);
+        putGpPolyValue(gpf, nextLon - lon);
+        lat = nextLat;
+        lon = nextLon;
+    }
+    putc('"', gpf);
+    return ferror(gpf) == 0;
+}
+
+
+/*  Write str as a JSON string, without trailing blanks.  Its bytes are
+    taken as Latin-1, so those over 0x7F are escaped as the code points
+    they stand for rather than left as invalid UTF-8.  */
+static int putGpJsonStr(FILE *const gpf, const char *str) {
+
+    int len = (str == NULL) ? 0 : strlen(str);
+    while (len > 0 && chrset(str[len - 1], SPACE) == true)
+        len--;
+
+    putc('"', gpf);
+    for (int i = 0; i < len; i++) {
+        unsigned char c = str[i];
+        if (c == '"' || c == '\\')
+            putc('\\', gpf);
+        if (c < ' ' || c > 0x7F)
+            fprintf(gpf, "\\u%04x", c);
+        else
+            putc(str[i], gpf);
+    }
+    putc('"', gpf);
+    return ferror(gpf) == 0;
+}
+
+
+/*  Check if num is one of the n numbers in list, n = -1 matching any  */
+static _Bool gpSelected(int num, const int *list, int n) {
+
+    if (n == -1)
+        return true;
+    for (int i = 0; i < n; i++) {
+        if (list[i] == num)
+            return true;
+    }
+    return false;
+}
+
+
+/*  Write the components of filep chosen by spec as a JSON object for the map
+    viewer, streaming each component as it is reached. Routes, tracks and the
+    trackpoints are written as encoded polylines (see writeGpPolyline()):
+        {"units": [dist, speed],
+         "waypts": [{"id", "lat", "lon", "symbol", "text"}, ...],
+         "routes": [{"num", "comment", "points"}, ...],
+         "trkpts": points,
+         "tracks": [{"seqno", "start", "duration", "dist", "speed",
+                     "points"}, ...]}
+    Paramaters: gpf is the output stream
+                spec selects the components, and the simplification
+                tolerance applied to trackpoints and tracks
+    Returns:    0 on a write error  */
+int writeGpMapData( FILE *const gpf, const GpFile *filep,
+                    const GpMapSpec *spec ) {
+
+    char dist_units[][8] = {
+        ['M'] = "m", ['K'] = "km", ['F'] = "ft", ['N'] = "nm", ['S'] = "miles"
+    };
+    char speed_units[][8] = {
+        ['M'] = "m/s", ['K'] = "km/h", ['F'] = "ft/s", ['N'] = "knots",
+        ['S'] = "mph"
+    };
+    int size = filep->ntrkpts, n = 0, ok = 1;
+    GpCoord *coord;
+    _Bool *keep;
+    GpTrack *tp;
+    int n_tracks;
+
+    // scratch space for the longest route or all trackpoints
+    for (int i = 0; i < filep->nroutes; i++) {
+        if (filep->route[i]->npoints > size)
+            size = filep->route[i]->npoints;
+    }
+    coord = malloc((size + 1) * sizeof(GpCoord));
+    keep = malloc((filep->ntrkpts + 1) * sizeof(_Bool));
+    assert(coord != NULL && keep != NULL);
+
+    fprintf(gpf, "{\"units\": [\"%s\", \"%s\"],\n\"waypts\": [",
+            dist_units[(int)filep->unitHorz],
+            speed_units[(int)filep->unitHorz]);
+    for (int i = 0; spec->waypts == true && i < filep->nwaypts; i++) {
+        GpWaypt *wp = filep->waypt + i;
+        char text[strlen(wp->ID) + strlen(wp->comment) + 4];
+        int len = strlen(wp->ID);
+
+        // text shown with the marker, as chosen by textChoice
+        while (len > 0 && chrset(wp->ID[len - 1], SPACE) == true)
+            len--;
+        if (chrset(wp->textChoice, "I+") == true)
+            sprintf(text, "%.*s", len, wp->ID);
+        else if (chrset(wp->textChoice, "C^") == true)
+            strcpy(text, wp->comment);
+        else if (wp->textChoice == '&')
+            sprintf(text, "%.*s - %s", len, wp->ID, wp->comment);
+        else
+            strcpy(text, "");
+
+        fprintf(gpf, "%s\n {\"id\": ", (i > 0) ? "," : "");
+        putGpJsonStr(gpf, wp->ID);
+        fprintf(gpf, ", \"lat\": %lf, \"lon\": %lf, \"symbol\": ",
+                wp->coord.lat, wp->coord.lon);
+        putGpJsonStr(gpf, wp->symbol);
+        fprintf(gpf, ", \"text\": ");
+        putGpJsonStr(gpf, text);
+        putc('}', gpf);
+    }
+
+    fprintf(gpf, "],\n\"routes\": [");
+    for (int i = 0; i < filep->nroutes; i++) {
+        GpRoute *rp = filep->route[i];
+        if (gpSelected(rp->number, spec->route, spec->nroutes) == false)
+            continue;
+        for (int j = 0; j < rp->npoints; j++)
+            coord[j] = filep->waypt[rp->leg[j]].coord;
+        fprintf(gpf, "%s\n {\"num\": %d, \"comment\": ",
+                (n++ > 0) ? "," : "", rp->number);
+        putGpJsonStr(gpf, rp->comment);
+        fprintf(gpf, ", \"points\": ");
+        ok = ok && writeGpPolyline(gpf, coord, rp->npoints);
+        putc('}', gpf);
+    }
+
+    // trackpoints and tracks share the simplified points
+    if (spec->tolerance > 0) {
+        simplifyGpTrkpts(filep, spec->tolerance, keep);
+    }
+    else {
+        for (int i = 0; i < filep->ntrkpts; i++)
+            keep[i] = true;
+    }
+    n = 0;
+    for (int i = 0; spec->trkpts == true && i < filep->ntrkpts; i++) {
+        if (keep[i] == true)
+            coord[n++] = filep->trkpt[i].coord;
+    }
+    fprintf(gpf, "],\n\"trkpts\": ");
+    ok = ok && writeGpPolyline(gpf, coord, n);
+
+    fprintf(gpf, ",\n\"tracks\": [");
+    n_tracks = getGpTracks(filep, &tp);
+    n = 0;
+    for (int i = 0; i < n_tracks; i++) {
+        int end = (i < n_tracks - 1) ? tp[i+1].seqno - 1 : filep->ntrkpts;
+        int npts = 0;
+        char buf[BUFSIZE] = "";
+        struct tm timebuf;
+
+        if (gpSelected(tp[i].seqno, spec->track, spec->ntracks) == false)
+            continue;
+        for (int j = tp[i].seqno - 1; j < end; j++) {
+            if (keep[j] == true)
+                coord[npts++] = filep->trkpt[j].coord;
+        }
+        if (localtime_r(&tp[i].startTrk, &timebuf) != NULL
+            && strftime(buf, BUFSIZE, filep->dateFormat, &timebuf) > 0)
+            strftime(buf + strlen(buf), BUFSIZE - strlen(buf), " %X",
+                     &timebuf);
+
+        fprintf(gpf, "%s\n {\"seqno\": %d, \"start\": ",
+                (n++ > 0) ? "," : "", tp[i].seqno);
+        putGpJsonStr(gpf, buf);
+        fprintf(gpf, ", \"duration\": \"%d:%02d:%02d\", \"dist\": %lf, "
+                "\"speed\": %f, \"points\": ", (int)tp[i].duration / 3600,
+                (int)tp[i].duration / 60 % 60, (int)tp[i].duration % 60,
+                tp[i].dist, isfinite(tp[i].speed) ? tp[i].speed : 0);
+        ok = ok && writeGpPolyline(gpf, coord, npts);
+        putc('}', gpf);
+    }
+    fprintf(gpf, "]}\n");
+
+    free(tp);
+    free(coord);
+    free(keep);
+    return ok && ferror(gpf) == 0;
+}
+
+
+typedef struct {    // trackpoint placed in a tile by getGpTiles()
+    long long tile;     // y * 2^zoom + x
+    long pos;           // position along all lines, 2 per kept point
+    int seqno;          // track seqno
+    int index;          // trackpoint subscript
+} GpTileEntry;
+
+
+static int compGpTileEntry(const void *e1, const void *e2) {
+
+    const GpTileEntry *a = e1, *b = e2;
+    if (a->tile != b->tile)
+        return (a->tile < b->tile) ? -1 : 1;
+    return (a->pos < b->pos) ? -1 : (a->pos > b->pos);
+}
+
+
+/*  Web Mercator tile of coord at zoom  */
+static long long gpTileKey(GpCoord coord, int zoom) {
+
+    double n = ldexp(1, zoom);
+    double lat = RAD(fmax(-85.0511, fmin(85.0511, coord.lat)));
+    double x = (coord.lon + 180) / 360 * n;
+    double y = (1 - log(tan(lat) + 1 / cos(lat)) / M_PI) / 2 * n;
+    long long col = (long long)fmin(n - 1, fmax(0, floor(x)));
+    long long row = (long long)fmin(n - 1, fmax(0, floor(y)));
+    return row * (long long)n + col;
+}
+
+
+/*  Split the kept trackpoints of each track into lines per Web Mercator tile
+    at zoom. A line leaving or entering a tile includes the point on the other
+    side of the tile edge so the tiles join up when drawn.
+    Paramaters: keep flags the trackpoints to draw (e.g. from
+                simplifyGpTrkpts()), or NULL for all of them
+                tiles will point to an allocated array of tiles ordered by
+                row then column, to be freed with freeGpTiles()
+    Returns:    the no. of tiles   */
+int getGpTiles( const GpFile *filep, const int zoom, const _Bool *keep,
+                GpTile **tiles ) {
+
+    GpTileEntry *entry = malloc((3 * filep->ntrkpts + 1) * sizeof(GpTileEntry));
+    int nentries = 0, ntiles = 0, npoints = 0;
+    int seqno = 0, prev = -1;
+    long pos = 0;
+    long long prevTile = -1;
+    int *point;
+
+    assert(entry != NULL);
+    *tiles = NULL;
+    for (int i = 0; i < filep->ntrkpts; i++) {
+        long long tile;
+        if (filep->trkpt[i].segFlag == true || i == 0) {
+            seqno = i + 1;
+            prev = -1;
+            pos += 4;   // never continue a line into the next track
+        }
+        if (keep != NULL && keep[i] == false)
+            continue;
+        tile = gpTileKey(filep->trkpt[i].coord, zoom);
+        pos += 2;
+        // line crosses a tile edge: each side gets the other's end point
+        if (prev != -1 && tile != prevTile) {
+            GpTileEntry out = { prevTile, pos - 1, seqno, i };
+            GpTileEntry in = { tile, pos - 1, seqno, prev };
+            entry[nentries++] = out;
+            entry[nentries++] = in;
+        }
+        GpTileEntry e = { tile, pos, seqno, i };
+        entry[nentries++] = e;
+        prev = i;
+        prevTile = tile;
+    }
+    qsort(entry, nentries, sizeof(GpTileEntry), compGpTileEntry);
+
+    // count tiles & lines, a line breaks where a tile's positions jump
+    for (int i = 0; i < nentries; i++) {
+        if (i == 0 || entry[i].tile != entry[i-1].tile)
+            ntiles++;
+        if (i == 0 || entry[i].tile != entry[i-1].tile
+            || entry[i].pos - entry[i-1].pos > 2)
+            npoints++;
+        npoints++;
+    }
+    if (ntiles == 0) {
+        free(entry);
+        return 0;
+    }
+
+    *tiles = malloc(ntiles * sizeof(GpTile));
+    point = malloc(npoints * sizeof(int));
+    assert(*tiles != NULL && point != NULL);
+    ntiles = npoints = 0;
+    for (int i = 0; i < nentries; i++) {
+        if (i == 0 || entry[i].tile != entry[i-1].tile) {
+            GpTile *tp = *tiles + ntiles++;
+            long long n = (long long)1 << zoom;
+            tp->zoom = zoom;
+            tp->x = (long)(entry[i].tile % n);
+            tp->y = (long)(entry[i].tile / n);
+            tp->npoints = 0;
+            tp->point = point + npoints;
+        }
+        GpTile *tp = *tiles + ntiles - 1;
+        if (tp->npoints == 0 || entry[i].pos - entry[i-1].pos > 2) {
+            tp->point[tp->npoints++] = -entry[i].seqno;
+            npoints++;
+        }
+        tp->point[tp->npoints++] = entry[i].index;
+        npoints++;
+    }
+    free(entry);
+    return ntiles;
+}
+
+
+/*  Write a tile as a JSON object:
+        {"zoom", "x", "y", "lines": [{"seqno", "points"}, ...]}
+    each line's points being an encoded polyline (see writeGpPolyline()).
+    Returns:    0 on a write error  */
+int writeGpTile( FILE *const gpf, const GpFile *filep, const GpTile *tile ) {
+
+    GpCoord *coord = malloc((tile->npoints + 1) * sizeof(GpCoord));
+    int ok = 1;
+
+    assert(coord != NULL);
+    fprintf(gpf, "{\"zoom\": %d, \"x\": %ld, \"y\": %ld, \"lines\": [",
+            tile->zoom, tile->x, tile->y);
+    for (int i = 0; i < tile->npoints; ) {
+        int seqno = -tile->point[i++], n = 0;
+        while (i < tile->npoints && tile->point[i] >= 0)
+            coord[n++] = filep->trkpt[tile->point[i++]].coord;
+        fprintf(gpf, "%s\n {\"seqno\": %d, \"points\": ",
+                (i > n + 1) ? "," : "", seqno);
+        ok = ok && writeGpPolyline(gpf, coord, n);
+        putc('}', gpf);
+    }
+    fprintf(gpf, "]}\n");
+    free(coord);
+    return ok && ferror(gpf) == 0;
+}
+
+
+void freeGpTiles( GpTile *tiles, const int ntiles ) {
+
+    if (tiles == NULL)
+        return;
+    if (ntiles > 0)
+        free(tiles[0].point);
+    free(tiles);
+}
+
+
+/*  Value of column col for trackpoint tp of the track seqno  */
+static double getGpColValue( const GpTrkpt *tp, const int seqno,
+                             const GpColumn col ) {
+
+    switch (col) {
+        case GP_COL_LAT:    return tp->coord.lat;
+        case GP_COL_LON:    return tp->coord.lon;
+        case GP_COL_TIME:   return (double)tp->dateTime;
+        case GP_COL_DIST:   return tp->dist;
+        case GP_COL_SPEED:  return tp->speed;
+        default:            return seqno;
+    }
+}
+
+
+/*  Bytes taken by nrows values of column col, padded to 8  */
+static long getGpColSize( const GpColumn col, const long nrows ) {
+
+    long size = (col == GP_COL_SPEED || col == GP_COL_SEG) ? 4 * nrows
+                                                          : 8 * nrows;
+    return (size + 7) / 8 * 8;
+}
+
+
+int writeGpColumns( FILE *const gpf, const GpFile *filep ) {
+
+    int nchunks = (filep->ntrkpts + GP_COLCHUNK - 1) / GP_COLCHUNK;
+    GpColHeader head = { GP_COLMAGIC, 0x01020304, nchunks, filep->ntrkpts,
+                         filep->unitHorz, filep->unitTime, { 0 } };
+    GpColChunk *chunk = calloc(nchunks + 1, sizeof(GpColChunk));
+    int *seqno = malloc((filep->ntrkpts + 1) * sizeof(int));
+    unsigned char *buf = malloc(8 * GP_COLCHUNK);
+    int64_t offset = sizeof(head) + nchunks * sizeof(GpColChunk);
+    int ok;
+
+    assert(chunk != NULL && seqno != NULL && buf != NULL);
+    for (int i = 0, s = 0; i < filep->ntrkpts; i++) {
+        if (filep->trkpt[i].segFlag == true)
+            s = i + 1;
+        seqno[i] = s;
+    }
+
+    // directory: where each chunk goes & its columns' ranges
+    for (int c = 0; c < nchunks; c++) {
+        GpColChunk *cp = chunk + c;
+        int first = c * GP_COLCHUNK;
+        cp->offset = offset;
+        cp->nrows = MIN(GP_COLCHUNK, filep->ntrkpts - first);
+        for (GpColumn col = 0; col < GP_NCOLS; col++) {
+            cp->min[col] = INFINITY;
+            cp->max[col] = -INFINITY;
+            for (int i = first; i < first + cp->nrows; i++) {
+                double v = getGpColValue(filep->trkpt + i, seqno[i], col);
+                cp->min[col] = MIN(cp->min[col], v);
+                cp->max[col] = MAX(cp->max[col], v);
+            }
+            offset += getGpColSize(col, cp->nrows);
+        }
+    }
+    ok = fwrite(&head, sizeof(head), 1, gpf) == 1
+         && fwrite(chunk, sizeof(GpColChunk), nchunks, gpf) == nchunks;
+
+    // each chunk's columns in turn
+    for (int c = 0; c < nchunks && ok; c++) {
+        const GpTrkpt *tp = filep->trkpt + c * GP_COLCHUNK;
+        const int *sp = seqno + c * GP_COLCHUNK;
+        int n = chunk[c].nrows;
+        for (GpColumn col = 0; col < GP_NCOLS && ok; col++) {
+            long size = getGpColSize(col, n);
+            memset(buf + size - 8, 0, 8);
+            for (int i = 0; i < n; i++) {
+                if (col == GP_COL_TIME)
+                    ((int64_t *)buf)[i] = tp[i].dateTime;
+                else if (col == GP_COL_SPEED)
+                    ((float *)buf)[i] = tp[i].speed;
+                else if (col == GP_COL_SEG)
+                    ((int32_t *)buf)[i] = sp[i];
+                else
+                    ((double *)buf)[i] = getGpColValue(tp + i, sp[i], col);
+            }
+            ok = fwrite(buf, 1, size, gpf) == size;
+        }
+    }
+
+    free(chunk);
+    free(seqno);
+    free(buf);
+    return ok && ferror(gpf) == 0;
+}
+
+
+static int compGpTrackStart(const void *t1, const void *t2) {
+
+    const GpTrack *a = t1, *b = t2;
+    return (a->startTrk > b->startTrk) - (a->startTrk < b->startTrk);
+}
+
+
+/*  Test whether coord is inside the box SW..NE, which may cross the
+    antimeridian (SW.lon > NE.lon)  */
+static _Bool inGpBox(GpCoord coord, GpCoord SW, GpCoord NE) {
+
+    if (coord.lat < SW.lat || coord.lat > NE.lat)
+        return false;
+    if (SW.lon <= NE.lon)
+        return coord.lon >= SW.lon && coord.lon <= NE.lon;
+    return coord.lon >= SW.lon || coord.lon <= NE.lon;
+}
+
+
+/*  Convert YYYY-MM-DD[THH:MM[:SS]] local time, as trackpoint times are read,
+    into *t; an empty string leaves *t unchanged  */
+static int parseGpTime( const char *str, time_t *t ) {
+
+    const char *formats[] = { "%Y-%m-%dT%H:%M:%S", "%Y-%m-%dT%H:%M",
+                              "%Y-%m-%d" };
+
+    if (*str == '\0')
+        return 1;
+    for (int i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        struct tm tm = { 0 };
+        char *p = strptime(str, formats[i], &tm);
+        if (p != NULL && *p == '\0') {
+            tm.tm_isdst = -1;
+            *t = mktime(&tm);
+            return *t != -1;
+        }
+    }
+    return 0;
+}
+
+
+/*  Parse a time window and/or a box, separated by '/', into filter: FROM..TO
+    with times as YYYY-MM-DD[THH:MM[:SS]] (either may be left out), and
+    SLAT,WLON,NLAT,ELON for the south-west & north-east corners.
+    Returns:    0 if str is not a valid filter, 1 otherwise  */
+int parseGpTrkptFilter( const char *str, GpTrkptFilter *filter ) {
+
+    char buf[strlen(str) + 1];
+    GpTrkptFilter f = { false, 0, 0, false, { 0, 0 }, { 0, 0 } };
+
+    *filter = f;
+    strcpy(buf, str);
+    for (char *p = strtok(buf, "/"); p != NULL; p = strtok(NULL, "/")) {
+        char *to = strstr(p, "..");
+        if (to != NULL) {
+            filter->byTime = true;
+            filter->from = 0;
+            filter->to = (time_t)LONG_MAX;
+            *to = '\0';
+            if (parseGpTime(p, &filter->from) == 0
+                || parseGpTime(to + 2, &filter->to) == 0)
+                return 0;
+        }
+        else {
+            char c;
+            filter->byBox = true;
+            if (sscanf(p, "%lf,%lf,%lf,%lf%c", &filter->SWcorner.lat,
+                       &filter->SWcorner.lon, &filter->NEcorner.lat,
+                       &filter->NEcorner.lon, &c) != 4
+                || filter->SWcorner.lat > filter->NEcorner.lat)
+                return 0;
+        }
+    }
+    return filter->byTime == true || filter->byBox == true;
+}
+
+
+/*  Check whether track could have trackpoints passing filter, from its time
+    span and bounding box alone  */
+_Bool overlapsGpTrack( const GpTrack *track, const GpTrkptFilter *filter ) {
+
+    if (filter->byTime == true
+        && (track->endTrk < filter->from || track->startTrk > filter->to))
+        return false;
+    if (filter->byBox == false)
+        return true;
+    if (track->NEcorner.lat < filter->SWcorner.lat
+        || track->SWcorner.lat > filter->NEcorner.lat)
+        return false;
+    // box crossing the antimeridian
+    if (filter->SWcorner.lon > filter->NEcorner.lon)
+        return track->NEcorner.lon >= filter->SWcorner.lon
+               || track->SWcorner.lon <= filter->NEcorner.lon;
+    return track->NEcorner.lon >= filter->SWcorner.lon
+           && track->SWcorner.lon <= filter->NEcorner.lon;
+}
+
+
+/*  Flag the trackpoints passing filter. Whole tracks are skipped using their
+    time spans (sorted by start time) and bounding boxes, and the time window
+    is found within a track by binary search, so trackpoints are assumed to be
+    in time order within each track.
+    Paramaters: keep must have room for filep->ntrkpts flags
+    Returns:    the no. of trackpoints flagged   */
+int selectGpTrkpts( const GpFile *filep, const GpTrkptFilter *filter,
+                    _Bool *keep ) {
+
+    GpTrack *tp;
+    int ntracks = getGpTracks(filep, &tp);
+    int lo = 0, hi = ntracks, nkept = 0;
+
+    for (int i = 0; i < filep->ntrkpts; i++)
+        keep[i] = false;
+
+    // tracks starting after the window are past hi
+    if (ntracks > 1)
+        qsort(tp, ntracks, sizeof(GpTrack), compGpTrackStart);
+    if (filter->byTime == true) {
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (tp[mid].startTrk <= filter->to)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+    }
+
+    for (int t = 0; t < hi; t++) {
+        int start = tp[t].seqno - 1, end = start + 1;
+        _Bool testBox = filter->byBox;
+
+        if (filter->byTime == true && tp[t].endTrk < filter->from)
+            continue;
+        if (filter->byBox == true) {
+            if (overlapsGpTrack(tp + t, filter) == false)
+                continue;
+            // box test per point unless the whole track is inside; a box
+            // crossing the antimeridian holds both corners of tracks that
+            // run outside it between them, so its points are always tested
+            if (filter->SWcorner.lon <= filter->NEcorner.lon)
+                testBox = !(inGpBox(tp[t].SWcorner, filter->SWcorner,
+                                    filter->NEcorner)
+                            && inGpBox(tp[t].NEcorner, filter->SWcorner,
+                                       filter->NEcorner));
+        }
+        while (end < filep->ntrkpts && filep->trkpt[end].segFlag == false)
+            end++;
+
+        if (filter->byTime == true) {
+            int a = start, b = end;
+            while (a < b) {     // first point not before from
+                int mid = (a + b) / 2;
+                if (filep->trkpt[mid].dateTime < filter->from)
+                    a = mid + 1;
+                else
+                    b = mid;
+            }
+            start = a;
+            b = end;
+            while (a < b) {     // first point after to
+                int mid = (a + b) / 2;
+                if (filep->trkpt[mid].dateTime <= filter->to)
+                    a = mid + 1;
+                else
+                    b = mid;
+            }
+            end = a;
+        }
+
+        for (int i = start; i < end; i++) {
+            if (testBox == false || inGpBox(filep->trkpt[i].coord,
+                                       filter->SWcorner, filter->NEcorner)) {
+                keep[i] = true;
+                nkept++;
+            }
+        }
+    }
+    free(tp);
+    return nkept;
+}
+
+
+/*  Remove the trackpoints not flagged in keep. Each run of consecutive kept
+    trackpoints becomes a segment of its own: a run starting inside a segment
+    takes that segment's comment, and its distances & durations are rebased
+    to the run's first point.
+    Returns:    the no. of trackpoints left  */
+int keepGpTrkpts( GpFile *filep, const _Bool *keep ) {
+
+    const char *comment = "";
+    char *dropped = NULL;   // comment of a dropped segment start
+    double baseDist = 0;
+    long baseDuration = 0;
+    int n = 0;
+
+    for (int i = 0; i < filep->ntrkpts; i++) {
+        GpTrkpt *tp = filep->trkpt + i;
+        _Bool startsRun = keep[i] == true
+                          && (i == 0 || keep[i-1] == false
+                              || tp->segFlag == true);
+
+        if (tp->segFlag == true) {
+            free(dropped);
+            dropped = (keep[i] == false) ? tp->comment : NULL;
+            comment = tp->comment;
+        }
+        if (keep[i] == false)
+            continue;
+
+        if (startsRun == true) {
+            if (tp->segFlag == false) {
+                baseDist = tp->dist;
+                baseDuration = tp->duration;
+                tp->segFlag = true;
+                tp->comment = newstr((char *)comment);
+                tp->speed = 0;
+            }
+            else {
+                baseDist = 0;
+                baseDuration = 0;
+            }
+            tp->dist = 0;
+            tp->duration = 0;
+        }
+        else {
+            tp->dist -= baseDist;
+            tp->duration -= baseDuration;
+        }
+        filep->trkpt[n++] = *tp;
+    }
+    free(dropped);
+    filep->ntrkpts = n;
+    return n;
+}
+
+
+/*  Position of a trackpoint along its segment for resampling mode  */
+static double gpTrkptParam(const GpTrkpt *tp, char mode) {
+
+    if (tp->segFlag == true)
+        return 0;
+    return (mode == 't') ? tp->duration : tp->dist;
+}
+
+
+/*  Trackpoint at param between trackpoints a & b, by linear interpolation  */
+static GpTrkpt interpGpTrkpt(const GpTrkpt *a, const GpTrkpt *b, char mode,
+                             double param) {
+
+    double pa = gpTrkptParam(a, mode), pb = gpTrkptParam(b, mode);
+    double f = (pb > pa) ? (param - pa) / (pb - pa) : 1;
+    double dlon = b->coord.lon - a->coord.lon;
+    double distA = (a->segFlag == true) ? 0 : a->dist;
+    long durA = (a->segFlag == true) ? 0 : a->duration;
+    GpTrkpt tp = *b;
+
+    // the short way round across the antimeridian
+    if (dlon > 180)
+        dlon -= 360;
+    else if (dlon < -180)
+        dlon += 360;
+    tp.coord.lat = a->coord.lat + f * (b->coord.lat - a->coord.lat);
+    tp.coord.lon = a->coord.lon + f * dlon;
+    if (tp.coord.lon > 180)
+        tp.coord.lon -= 360;
+    else if (tp.coord.lon < -180)
+        tp.coord.lon += 360;
+    tp.dateTime = a->dateTime + (time_t)lround(f * (b->dateTime - a->dateTime));
+    tp.duration = durA + lround(f * (b->duration - durA));
+    tp.dist = distA + f * (b->dist - distA);
+    if (isnan(a->alt) == false && isnan(b->alt) == false)
+        tp.alt = a->alt + f * (b->alt - a->alt);
+    tp.segFlag = false;
+    tp.comment = NULL;
+    return tp;
+}
+
+
+/*  Append trackpoint to the growing array *tp, setting its speed from the
+    previous trackpoint of the segment (keeping legSpeed for a zero time)  */
+static void addGpTrkpt(GpTrkpt **tp, int *n, int *size, GpTrkpt pt,
+                       float legSpeed, char unitTime) {
+
+    if (*n == *size) {
+        *size = (*size > 0) ? *size * 2 : 64;
+        *tp = realloc(*tp, *size * sizeof(GpTrkpt));
+        assert(*tp != NULL);
+    }
+    if (pt.segFlag == false) {
+        GpTrkpt *prev = *tp + *n - 1;
+        double dist = (prev->segFlag == true) ? 0 : prev->dist;
+        long duration = (prev->segFlag == true) ? 0 : prev->duration;
+        pt.speed = legSpeed;
+        if (pt.duration > duration)
+            pt.speed = (pt.dist - dist) / (pt.duration - duration)
+                       * ((unitTime == 'H') ? 3600 : 1);
+    }
+    (*tp)[(*n)++] = pt;
+}
+
+
+/*  Resample each track at a uniform step, interpolating coordinates & times
+    linearly between the original trackpoints, in one pass. Every segment
+    keeps its first & last trackpoints, and distances & durations stay
+    measured along the original track.
+    Paramaters: mode is one of
+                    't' step is a time (sec.)
+                    'd' step is a distance (unitHorz)
+                    'n' step is the most trackpoints per segment (at least 2),
+                        evenly spaced by distance; shorter segments are
+                        copied unchanged
+                tp will point to the allocated array of new trackpoints, the
+                caller to free it and each segment start's comment
+    Returns:    the no. of new trackpoints, or -1 for an invalid mode or step */
+int resampleGpTrkpts( const GpFile *filep, const char mode, const double step,
+                      GpTrkpt **tp ) {
+
+    int n = 0, size = 0;
+
+    *tp = NULL;
+    if ((mode != 't' && mode != 'd' && mode != 'n') || !(step > 0)
+        || (mode == 'n' && step < 2) || (mode == 't' && step < 1))
+        return -1;
+
+    for (int start = 0, end; start < filep->ntrkpts; start = end) {
+        const GpTrkpt *seg = filep->trkpt + start;
+        char param = (mode == 'n') ? 'd' : mode;
+        double total, delta = step;
+        GpTrkpt first = *seg;
+
+        for (end = start + 1; end < filep->ntrkpts
+                              && filep->trkpt[end].segFlag == false; end++)
+            ;
+        total = gpTrkptParam(filep->trkpt + end - 1, param);
+        if (mode == 'n')
+            delta = total / ((long)step - 1);
+
+        first.comment = (seg->comment != NULL) ? newstr(seg->comment) : NULL;
+        addGpTrkpt(tp, &n, &size, first, 0, filep->unitTime);
+        if (mode == 'n' && end - start <= (long)step) {
+            for (int i = start + 1; i < end; i++)
+                addGpTrkpt(tp, &n, &size, filep->trkpt[i],
+                           filep->trkpt[i].speed, filep->unitTime);
+            continue;
+        }
+
+        // samples at whole steps, short of the last trackpoint by a margin
+        // so rounding doesn't put one on top of it
+        double next = delta;
+        for (int i = start + 1; i < end && delta > 0; i++) {
+            const GpTrkpt *a = filep->trkpt + i - 1, *b = filep->trkpt + i;
+            while (next <= gpTrkptParam(b, param)
+                   && next < total - delta * 1e-6) {
+                if (next >= gpTrkptParam(a, param))
+                    addGpTrkpt(tp, &n, &size, interpGpTrkpt(a, b, param, next),
+                               b->speed, filep->unitTime);
+                next += delta;
+            }
+        }
+        if (end - start > 1)
+            addGpTrkpt(tp, &n, &size, filep->trkpt[end - 1],
+                       filep->trkpt[end - 1].speed, filep->unitTime);
+    }
+    return n;
+}
+
+
+/*  Recompute each trackpoint's distance & duration from the start of its
+    segment, and its speed from the previous trackpoint, using the coordinates
+    (great-circle distance) and times, and compare them with the values read.
+    All the leg distances are computed in one pass before the comparison.
+    Paramaters: tolerance is the relative error allowed in distance & speed,
+                on top of half the last place GPSU writes them to (rounding)
+                fix true to also replace the values read with the new ones
+                cp gets the counts off and the largest errors of all the
+                trackpoints, within tolerance or not
+    Returns:    the no. of trackpoints with a field off (=cp->npoints)  */
+#define GP_DIST_SLACK 0.0005  // distances are written to 3 places
+#define GP_SPEED_SLACK 0.05   // speeds to 1
+
+int checkGpTrkpts( GpFile *filep, const double tolerance, const _Bool fix,
+                   GpTrkptCheck *cp ) {
+
+    GpCoord *coord = malloc((filep->ntrkpts + 1) * sizeof(GpCoord));
+    double *leg = malloc((filep->ntrkpts + 1) * sizeof(double));
+    double factor = getGpUnitFactor(filep->unitHorz);
+    double perSec = (filep->unitTime == 'H') ? 3600 : 1;
+    double dist = 0;
+    time_t start = 0;
+    GpTrkptCheck check = { 0, 0, 0, 0, 0, 0, 0, -1 };
+
+    assert(coord != NULL && leg != NULL);
+    for (int i = 0; i < filep->ntrkpts; i++)
+        coord[i] = filep->trkpt[i].coord;
+    getGpLegDists(coord, filep->ntrkpts, leg);
+
+    for (int i = 0; i < filep->ntrkpts; i++) {
+        GpTrkpt *tp = filep->trkpt + i;
+        long duration, legTime;
+        double speed, err;
+        _Bool off = false;
+
+        if (tp->segFlag == true || i == 0) {
+            dist = 0;
+            start = tp->dateTime;
+            continue;
+        }
+        dist += leg[i] * factor;
+        duration = (long)(tp->dateTime - start);
+        legTime = (long)(tp->dateTime - filep->trkpt[i-1].dateTime);
+        speed = (legTime > 0) ? leg[i] * factor / legTime * perSec : 0;
+
+        err = fabs(tp->dist - dist);
+        check.maxDist = fmax(check.maxDist, err);
+        if (err > tolerance * dist + GP_DIST_SLACK) {
+            check.ndist++;
+            off = true;
+        }
+        err = fabs(tp->speed - speed);
+        check.maxSpeed = fmax(check.maxSpeed, err);
+        if (err > tolerance * speed + GP_SPEED_SLACK) {
+            check.nspeed++;
+            off = true;
+        }
+        if (labs(tp->duration - duration) > check.maxDuration)
+            check.maxDuration = labs(tp->duration - duration);
+        if (tp->duration != duration) {
+            check.nduration++;
+            off = true;
+        }
+        if (off == true) {
+            if (check.first == -1)
+                check.first = i;
+            check.npoints++;
+        }
+        if (fix == true) {
+            tp->dist = dist;
+            tp->speed = (float)speed;
+            tp->duration = duration;
+        }
+    }
+    free(coord);
+    free(leg);
+    *cp = check;
+    return check.npoints;
+}
+
+
+/*  Split segments where the track has a time gap, a stop or a distance jump,
+    in one pass over the trackpoints. The trackpoint after the gap, jump or
+    stop starts the new segment, commented with the old segment's comment and
+    the reason, and the distances & durations after it are rebased to it.
+    Returns:    the no. of segments added   */
+int splitGpTracks( GpFile *filep, const GpSplitSpec *spec ) {
+
+    double factor = getGpUnitFactor(filep->unitHorz);
+    const char *comment = "";
+    double baseDist = 0;
+    long baseDuration = 0;
+    int anchor = 0, nsplits = 0;
+
+    for (int i = 0; i < filep->ntrkpts; i++) {
+        GpTrkpt *tp = filep->trkpt + i, *prev = tp - 1;
+        const char *reason = NULL;
+
+        if (tp->segFlag == true || i == 0) {
+            comment = (tp->comment != NULL) ? tp->comment : "";
+            baseDist = 0;
+            baseDuration = 0;
+            anchor = i;
+            continue;
+        }
+
+        if (spec->maxGap > 0 && tp->dateTime - prev->dateTime > spec->maxGap) {
+            reason = "gap";
+        }
+        else if (spec->maxJump > 0 && getGpDistance(prev->coord, tp->coord)
+                                      * factor > spec->maxJump) {
+            reason = "jump";
+        }
+        else if (spec->minStop > 0 && getGpDistance(filep->trkpt[anchor].coord,
+                                        tp->coord) * factor > spec->stopRadius) {
+            // left the spot: a stop if stayed there long enough
+            if (prev->dateTime - filep->trkpt[anchor].dateTime
+                >= spec->minStop && prev != filep->trkpt + anchor)
+                reason = "stop";
+            anchor = i;
+        }
+
+        if (reason == NULL) {
+            tp->dist -= baseDist;
+            tp->duration -= baseDuration;
+            continue;
+        }
+        baseDist = tp->dist;
+        baseDuration = tp->duration;
+        tp->segFlag = true;
+        tp->comment = malloc(strlen(comment) + strlen(reason) + 10);
+        assert(tp->comment != NULL);
+        sprintf(tp->comment, "%s%safter %s", comment,
+                (*comment != '\0') ? " - " : "", reason);
+        tp->dist = 0;
+        tp->duration = 0;
+        tp->speed = 0;
+        anchor = i;
+        nsplits++;
+    }
+    return nsplits;
+}
+
+
+/*  Rearrange v so that v[k] is the value that would be there if v were sorted
+    (quickselect), in linear time on average  */
+static float selectGpValue(float *v, int n, int k) {
+
+    int lo = 0, hi = n - 1;
+
+    while (lo < hi) {
+        float pivot = v[(lo + hi) / 2];
+        int i = lo, j = hi;
+        while (i <= j) {
+            while (v[i] < pivot)
+                i++;
+            while (v[j] > pivot)
+                j--;
+            if (i <= j) {
+                float t = v[i];
+                v[i++] = v[j];
+                v[j--] = t;
+            }
+        }
+        if (k <= j)
+            hi = j;
+        else if (k >= i)
+            lo = i;
+        else
+            break;
+    }
+    return v[k];
+}
+
+
+/*  Compute statistics for each track in one pass over its trackpoints, using
+    each trackpoint's speed & time from the previous one.
+    Paramaters: stopSpeed is the speed (unitHorz per unitTime) at or below
+                which a leg counts as stopped
+                percentile (0-100) picks the leg speed for pctSpeed
+                sp will point to an allocated array of statistics, one per
+                track in file order, to be freed by the caller
+    Returns:    the no. of tracks   */
+int getGpTrackStats( const GpFile *filep, const float stopSpeed,
+                     const double percentile, GpTrackStats **sp ) {
+
+    float *speed = malloc((filep->ntrkpts + 1) * sizeof(float));
+    int ntracks = 0;
+
+    assert(speed != NULL);
+    *sp = NULL;
+    for (int start = 0, end; start < filep->ntrkpts; start = end) {
+        GpTrackStats st = { start + 1, 1, 0, 0, 0, 0, 0, 0, 0, NAN, NAN };
+        double moveDist = 0, prevAlt = filep->trkpt[start].alt;
+        int nlegs = 0;
+
+        if (isnan(prevAlt) == false)
+            st.minAlt = st.maxAlt = prevAlt;
+
+        for (end = start + 1; end < filep->ntrkpts
+                              && filep->trkpt[end].segFlag == false; end++) {
+            const GpTrkpt *tp = filep->trkpt + end;
+            long legTime = (long)(tp->dateTime - tp[-1].dateTime);
+            double legDist = tp->dist - ((end - 1 == start) ? 0 : tp[-1].dist);
+
+            if (legTime > 0 && tp->speed > stopSpeed) {
+                st.movingTime += legTime;
+                moveDist += legDist;
+            }
+            else if (legTime > 0) {
+                st.stoppedTime += legTime;
+            }
+            if (tp->speed > st.maxSpeed)
+                st.maxSpeed = tp->speed;
+            speed[nlegs++] = tp->speed;
+
+            if (isnan(tp->alt) == false) {
+                if (isnan(prevAlt) == false && tp->alt > prevAlt)
+                    st.climb += tp->alt - prevAlt;
+                else if (isnan(prevAlt) == false)
+                    st.descent += prevAlt - tp->alt;
+                if (isnan(st.minAlt) == true || tp->alt < st.minAlt)
+                    st.minAlt = tp->alt;
+                if (isnan(st.maxAlt) == true || tp->alt > st.maxAlt)
+                    st.maxAlt = tp->alt;
+                prevAlt = tp->alt;
+            }
+            st.npoints++;
+        }
+
+        if (st.movingTime > 0)
+            st.movingSpeed = moveDist / st.movingTime
+                             * ((filep->unitTime == 'H') ? 3600 : 1);
+        if (nlegs > 0)
+            st.pctSpeed = selectGpValue(speed, nlegs,
+                              (int)lround(percentile / 100 * (nlegs - 1)));
+
+        *sp = realloc(*sp, (ntracks + 1) * sizeof(GpTrackStats));
+        assert(*sp != NULL);
+        (*sp)[ntracks++] = st;
+    }
+    free(speed);
+    return ntracks;
+}
+
+
+/*  Merge the trackpoints of two files in time order, in one pass over both,
+    for recordings of the same trip by more than one logger. Each file's
+    trackpoints must be in time order, and B's already in A's time zone &
+    units. A trackpoint within dupTime & dupDist of the last one merged is
+    dropped as a duplicate. A segment start only starts a new segment if the
+    other file isn't part way through a segment at that time; otherwise the
+    two segments are joined. The distances, speeds & durations are copied
+    as is, so should be recomputed (see checkGpTrkpts()).
+    Paramaters: dupDist is in unitHorz
+                tp will point to an allocated array of the merged trackpoints,
+                with copies of the comments, to be freed by the caller
+    Returns:    the no. of merged trackpoints  */
+int mergeGpTrkpts( const GpFile *filep, const GpFile *filepB,
+                   const long dupTime, const double dupDist, GpTrkpt **tp ) {
+
+    const GpFile *src[2] = { filep, filepB };
+    int next[2] = { 0, 0 };
+    double factor = getGpUnitFactor(filep->unitHorz);
+    int n = 0;
+
+    *tp = malloc((filep->ntrkpts + filepB->ntrkpts + 1) * sizeof(GpTrkpt));
+    assert(*tp != NULL);
+
+    while (next[0] < src[0]->ntrkpts || next[1] < src[1]->ntrkpts) {
+        // take the earlier trackpoint, A's on a tie
+        int s = (next[1] >= src[1]->ntrkpts
+                 || (next[0] < src[0]->ntrkpts
+                     && src[0]->trkpt[next[0]].dateTime
+                        <= src[1]->trkpt[next[1]].dateTime)) ? 0 : 1;
+        const GpFile *other = src[1 - s];
+        int o = next[1 - s];
+        GpTrkpt pt = src[s]->trkpt[next[s]++];
+        _Bool otherOpen = o > 0 && o < other->ntrkpts
+                          && other->trkpt[o].segFlag == false;
+
+        if (n > 0) {
+            GpTrkpt *last = *tp + n - 1;
+            if (labs((long)(pt.dateTime - last->dateTime)) <= dupTime
+                && getGpDistance(last->coord, pt.coord) * factor <= dupDist)
+                continue;
+        }
+        if (n == 0 || (pt.segFlag == true && otherOpen == false)) {
+            pt.segFlag = true;
+            pt.comment = newstr((pt.comment != NULL) ? pt.comment : "");
+        }
+        else {
+            pt.segFlag = false;
+            pt.comment = NULL;
+        }
+        (*tp)[n++] = pt;
+    }
+    return n;
+}
+
+
+typedef struct {    // waypoint being sorted by sortGpWaypts()
+    uint64_t prefix;    // first key, as an unsigned no. in the key's order
+    int index;          // subscript in array of waypoints
+} GpSortEntry;
+
+
+/*  Key value of field for a waypoint: the first 8 bytes of a string (the
+    rest compared by strcmp() on a tie), a distance's bits, or a Hilbert
+    curve position  */
+static uint64_t gpSortPrefix(const GpWaypt *wp, const GpSortKey *key) {
+
+    const char *str = (key->field == 's') ? wp->symbol
+                    : (key->field == 'c') ? wp->comment : wp->ID;
+    uint64_t prefix = 0;
+
+    if (key->field == 'd') {
+        double dist = getGpDistance(key->centre, wp->coord);
+        memcpy(&prefix, &dist, sizeof(prefix));  // order kept for dist >= 0
+        return prefix;
+    }
+    if (key->field == 'h') {
+        // 32 bits each of longitude & latitude, then Hilbert's xy to d
+        uint64_t x = (uint64_t)((wp->coord.lon + 180) / 360 * 4294967295.0);
+        uint64_t y = (uint64_t)((wp->coord.lat + 90) / 180 * 4294967295.0);
+        for (uint64_t s = (uint64_t)1 << 31; s > 0; s >>= 1) {
+            uint64_t rx = (x & s) > 0, ry = (y & s) > 0;
+            prefix += s * s * ((3 * rx) ^ ry);
+            if (ry == 0) {
+                if (rx == 1) {
+                    x = s - 1 - (x & (s - 1));
+                    y = s - 1 - (y & (s - 1));
+                }
+                uint64_t t = x;
+                x = y;
+                y = t;
+            }
+        }
+        return prefix;
+    }
+    for (int i = 0; i < 8; i++) {
+        prefix = (prefix << 8) | (unsigned char)*str;
+        if (*str != '\0')
+            str++;
+    }
+    return prefix;
+}
+
+
+static int compGpSortEntry(const GpWaypt *waypt, const GpSortKey *key,
+                           int nkeys, const GpSortEntry *a,
+                           const GpSortEntry *b) {
+
+    const GpWaypt *wa = waypt + a->index, *wb = waypt + b->index;
+
+    for (int k = 0; k < nkeys; k++) {
+        uint64_t pa = (k == 0) ? a->prefix : gpSortPrefix(wa, key + k);
+        uint64_t pb = (k == 0) ? b->prefix : gpSortPrefix(wb, key + k);
+        if (pa != pb)
+            return (pa < pb) ? -1 : 1;
+        if (chrset(key[k].field, "isc") == true) {
+            const char *sa = (key[k].field == 's') ? wa->symbol
+                           : (key[k].field == 'c') ? wa->comment : wa->ID;
+            const char *sb = (key[k].field == 's') ? wb->symbol
+                           : (key[k].field == 'c') ? wb->comment : wb->ID;
+            // equal prefixes of 8 chars, compare the rest
+            if (strlen(sa) > 8 && strlen(sb) > 8) {
+                int c = strcmp(sa + 8, sb + 8);
+                if (c != 0)
+                    return c;
+            }
+            else if (strlen(sa) != strlen(sb)) {
+                return (strlen(sa) < strlen(sb)) ? -1 : 1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+/*  Sort waypoints by the keys in order, equal waypoints keeping their order.
+    The waypoints are sorted as a permutation of (first key prefix, subscript)
+    pairs by merge sort, later keys only being computed on a tie, then moved
+    once and the route legs remapped through the inverse permutation.
+    Returns:    0 for an unknown key field, else 1   */
+int sortGpWaypts( GpFile *filep, const GpSortKey *key, const int nkeys ) {
+
+    int n = filep->nwaypts;
+    GpSortEntry *entry, *tmp;
+    GpWaypt *waypt;
+    int *inverse;
+
+    for (int k = 0; k < nkeys; k++) {
+        if (chrset(key[k].field, "iscdh") == false)
+            return 0;
+    }
+    if (n < 2 || nkeys == 0)
+        return 1;
+
+    entry = malloc(n * sizeof(GpSortEntry));
+    tmp = malloc(n * sizeof(GpSortEntry));
+    assert(entry != NULL && tmp != NULL);
+    for (int i = 0; i < n; i++) {
+        entry[i].prefix = gpSortPrefix(filep->waypt + i, key);
+        entry[i].index = i;
+    }
+
+    // bottom-up merge sort, stable
+    for (int width = 1; width < n; width *= 2) {
+        for (int lo = 0; lo < n; lo += 2 * width) {
+            int mid = (lo + width < n) ? lo + width : n;
+            int hi = (lo + 2 * width < n) ? lo + 2 * width : n;
+            int a = lo, b = mid, t = lo;
+            while (a < mid && b < hi) {
+                if (compGpSortEntry(filep->waypt, key, nkeys, entry + b,
+                                    entry + a) < 0)
+                    tmp[t++] = entry[b++];
+                else
+                    tmp[t++] = entry[a++];
+            }
+            while (a < mid)
+                tmp[t++] = entry[a++];
+            while (b < hi)
+                tmp[t++] = entry[b++];
+        }
+        GpSortEntry *swap = entry;
+        entry = tmp;
+        tmp = swap;
+    }
+
+    waypt = malloc(n * sizeof(GpWaypt));
+    inverse = malloc(n * sizeof(int));
+    assert(waypt != NULL && inverse != NULL);
+    for (int i = 0; i < n; i++) {
+        waypt[i] = filep->waypt[entry[i].index];
+        inverse[entry[i].index] = i;
+    }
+    for (int i = 0; i < filep->nroutes; i++) {
+        GpRoute *rp = filep->route[i];
+        for (int j = 0; j < rp->npoints; j++)
+            rp->leg[j] = inverse[rp->leg[j]];
+    }
+    free(filep->waypt);
+    filep->waypt = waypt;
+    free(inverse);
+    free(entry);
+    free(tmp);
+    return 1;
+}
+
+
+/*  Copy up to MAX_FIELD_LENGTH-1 bytes of str, without leading or trailing
+    blanks or line breaks, so it fits a GPSU field. In a token (ID or symbol)
+    blanks become '_'.  */
+static char *newGpField( const char *str, const _Bool token ) {
+
+    char buf[MAX_FIELD_LENGTH];
+    int len;
+
+    str += strspn(str, " \t\r\n");
+    len = strlen(str);
+    while (len > 0 && isspace((unsigned char)str[len-1]))
+        len--;
+    if (len > MAX_FIELD_LENGTH - 1) {
+        len = MAX_FIELD_LENGTH - 1;
+        // don't split a UTF-8 character
+        while (len > 0 && ((unsigned char)str[len] & 0xC0) == 0x80)
+            len--;
+    }
+    for (int i = 0; i < len; i++) {
+        buf[i] = isspace((unsigned char)str[i]) ? ' ' : str[i];
+        if (token == true && buf[i] == ' ')
+            buf[i] = '_';
+    }
+    buf[len] = '\0';
+    return newstr(buf);
+}
+
+
+/*  Parse an ISO 8601 (GPX) time, YYYY-MM-DDTHH:MM:SS[.sss][Z|+hh:mm|-hh:mm],
+    taken as UTC when there is no offset.
+    Returns:    0 if str is not such a time, 1 otherwise  */
+static int parseGpIsoTime( const char *str, time_t *t ) {
+
+    struct tm tm = { 0 };
+    double sec;
+    int n = 0, hh, mm;
+
+    if (sscanf(str, "%d-%d-%dT%d:%d:%lf%n", &tm.tm_year, &tm.tm_mon,
+               &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &sec, &n) != 6)
+        return 0;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_sec = (int)sec;
+    if ( (*t = timegm(&tm)) == -1)
+        return 0;
+    str += n;
+    if (*str == 'Z')
+        str++;
+    else if ((*str == '+' || *str == '-')
+             && sscanf(str + 1, "%2d:%2d%n", &hh, &mm, &n) == 2) {
+        *t -= (*str == '+' ? 1 : -1) * (hh * 3600 + mm * 60);
+        str += n + 1;
+    }
+    return *str == '\0' || isspace((unsigned char)*str);
+}
+
+
+/*  Parse all of str, but for blanks, as a number.
+    Returns:    0 if it is not one, 1 otherwise  */
+static int parseGpNumber( const char *str, double *x ) {
+
+    char *end;
+
+    *x = strtod(str, &end);
+    return end != str && end[strspn(end, " \t\r\n")] == '\0';
+}
+
+
+typedef struct {    // GPSU file being built by readGpGpx or readGpCsv
+    GpFile *filep;
+    int wsize, rsize, tsize;    // allocated lengths of filep's arrays
+    GpRoute *route;     // route being added to, NULL between routes
+    int *byID;          // hash table of waypoint subscripts by ID, -1 free
+    int nslots;         // its size, a power of 2 over twice the waypoints
+    time_t segStart;    // time of the segment's first trackpoint
+} GpImport;
+
+
+/*  Slot of ID in the waypoint hash table, or the free slot it would go in */
+static int findGpImportSlot( const GpImport *ip, const char *ID ) {
+
+    unsigned long h = 2166136261UL;     // FNV-1a
+    int slot;
+
+    for (const char *p = ID; *p != '\0'; p++)
+        h = (h ^ (unsigned char)*p) * 16777619UL;
+    slot = h & (ip->nslots - 1);
+    while (ip->byID[slot] != -1
+           && strcmp(ip->filep->waypt[ip->byID[slot]].ID, ID) != 0)
+        slot = (slot + 1) & (ip->nslots - 1);
+    return slot;
+}
+
+
+/*  Enter waypoint wp in the hash table, unless its ID is there already  */
+static void hashGpImportWaypt( GpImport *ip, const int wp ) {
+
+    int slot;
+
+    if (2 * (ip->filep->nwaypts + 1) > ip->nslots) {
+        free(ip->byID);
+        ip->nslots *= 2;
+        ip->byID = malloc(ip->nslots * sizeof(int));
+        assert(ip->byID != NULL);
+        memset(ip->byID, -1, ip->nslots * sizeof(int));
+        for (int i = 0; i < wp; i++) {
+            slot = findGpImportSlot(ip, ip->filep->waypt[i].ID);
+            if (ip->byID[slot] == -1)
+                ip->byID[slot] = i;
+        }
+    }
+    slot = findGpImportSlot(ip, ip->filep->waypt[wp].ID);
+    if (ip->byID[slot] == -1)
+        ip->byID[slot] = wp;
+}
+
+static void initGpImport( GpImport *ip, GpFile *filep ) {
+
+    filep->dateFormat = newstr(GP_DATEFORMAT);
+    filep->timeZone = GP_TIMEZONE;
+    filep->unitHorz = GP_UNITHORZ;
+    filep->unitTime = GP_UNITTIME;
+    filep->nwaypts = filep->nroutes = filep->ntrkpts = 0;
+    ip->filep = filep;
+    ip->wsize = ip->rsize = ip->tsize = 64;
+    filep->waypt = malloc(ip->wsize * sizeof(GpWaypt));
+    filep->route = malloc(ip->rsize * sizeof(GpRoute *));
+    filep->trkpt = malloc(ip->tsize * sizeof(GpTrkpt));
+    assert(filep->waypt != NULL && filep->route != NULL
+           && filep->trkpt != NULL);
+    ip->route = NULL;
+    ip->segStart = 0;
+    ip->nslots = 128;
+    ip->byID = malloc(ip->nslots * sizeof(int));
+    assert(ip->byID != NULL);
+    memset(ip->byID, -1, ip->nslots * sizeof(int));
+}
+
+
+/*  Append a waypoint, named WPn if id is blank.
+    Returns:    its subscript  */
+static int addGpImportWaypt( GpImport *ip, const char *id, GpCoord coord,
+                             const char *symbol, const char *comment ) {
+
+    GpFile *filep = ip->filep;
+    GpWaypt *wp;
+    char name[MAX_FIELD_LENGTH];
+
+    if (filep->nwaypts == ip->wsize) {
+        ip->wsize *= 2;
+        filep->waypt = realloc(filep->waypt, ip->wsize * sizeof(GpWaypt));
+        assert(filep->waypt != NULL);
+    }
+    wp = filep->waypt + filep->nwaypts;
+    if (id[strspn(id, SPACE)] == '\0') {
+        sprintf(name, "WP%d", filep->nwaypts + 1);
+        id = name;
+    }
+    wp->ID = newGpField(id, true);
+    wp->coord = coord;
+    wp->symbol = newGpField(symbol, true);
+    wp->textChoice = 'I';
+    wp->textPlace = 2;
+    wp->comment = newGpField(comment, false);
+    hashGpImportWaypt(ip, filep->nwaypts);
+    return filep->nwaypts++;
+}
+
+
+/*  Add the waypoint id (at coord, if it has to be added) to the route being
+    built  */
+static void addGpImportLeg( GpImport *ip, const char *id, GpCoord coord ) {
+
+    GpRoute *rp = ip->route;
+    char *name = newGpField(id, true);
+    int wp = (*name != '\0') ? ip->byID[findGpImportSlot(ip, name)] : -1;
+
+    if (wp == -1)
+        wp = addGpImportWaypt(ip, name, coord, "", "");
+    free(name);
+
+    rp = realloc(rp, sizeof(GpRoute) + (rp->npoints + 1) * sizeof(int));
+    assert(rp != NULL);
+    rp->leg[rp->npoints++] = wp;
+    ip->route = rp;
+}
+
+
+/*  Start a new route numbered number (0 for the next unused no.)  */
+static void startGpImportRoute( GpImport *ip, const int number,
+                                const char *comment ) {
+
+    ip->route = malloc(sizeof(GpRoute));
+    assert(ip->route != NULL);
+    ip->route->number = number;
+    ip->route->comment = newGpField(comment, false);
+    ip->route->npoints = 0;
+}
+
+
+/*  Add the route being built to the file.
+    Returns:    DUPRT if its no. is taken, OK otherwise  */
+static GpError endGpImportRoute( GpImport *ip ) {
+
+    GpFile *filep = ip->filep;
+    GpRoute *rp = ip->route;
+    int last = 0;
+
+    if (rp == NULL)
+        return OK;
+    ip->route = NULL;
+    for (int i = 0; i < filep->nroutes; i++) {
+        if (filep->route[i]->number == rp->number) {
+            free(rp->comment);
+            free(rp);
+            return DUPRT;
+        }
+        last = MAX(last, filep->route[i]->number);
+    }
+    if (rp->number <= 0)
+        rp->number = last + 1;
+    if (filep->nroutes == ip->rsize) {
+        ip->rsize *= 2;
+        filep->route = realloc(filep->route, ip->rsize * sizeof(GpRoute *));
+        assert(filep->route != NULL);
+    }
+    filep->route[filep->nroutes++] = rp;
+    return OK;
+}
+
+
+/*  Append a trackpoint, starting a segment with comment if segFlag is set
+    or the segment's duration would be out of range  */
+static void addGpImportTrkpt( GpImport *ip, GpCoord coord, time_t dateTime,
+                              double alt, _Bool segFlag,
+                              const char *comment ) {
+
+    GpFile *filep = ip->filep;
+    GpTrkpt *tp;
+
+    if (filep->ntrkpts == ip->tsize) {
+        ip->tsize *= 2;
+        filep->trkpt = realloc(filep->trkpt, ip->tsize * sizeof(GpTrkpt));
+        assert(filep->trkpt != NULL);
+    }
+    tp = filep->trkpt + filep->ntrkpts++;
+    memset(tp, 0, sizeof(GpTrkpt));
+    tp->coord = coord;
+    tp->dateTime = dateTime;
+    tp->alt = alt;
+    // GPSU durations run from 0 to under 24 hours, so a segment going back
+    // in time or on for a day is split
+    tp->segFlag = segFlag || filep->ntrkpts == 1 || dateTime < ip->segStart
+                  || dateTime - ip->segStart >= 24 * 60 * 60;
+    tp->comment = (tp->segFlag == true) ? newGpField(comment, false) : NULL;
+    if (tp->segFlag == true)
+        ip->segStart = dateTime;
+}
+
+
+/*  Finish the file being imported: add any route still open and derive the
+    trackpoints' distances, speeds and durations, or on an error free it.
+    Returns:    status  */
+static GpStatus endGpImport( GpImport *ip, GpStatus status ) {
+
+    GpTrkptCheck check;
+
+    free(ip->byID);
+    ip->byID = NULL;
+    if (status.code == OK)
+        status.code = endGpImportRoute(ip);
+    if (ip->route != NULL) {
+        free(ip->route->comment);
+        free(ip->route);
+        ip->route = NULL;
+    }
+    if (status.code != OK) {
+        freeGpFile(ip->filep);
+        return status;
+    }
+    checkGpTrkpts(ip->filep, 0, true, &check);
+
+    // a blank symbol can't be read back once any waypoint has one
+    for (int i = 0; i < ip->filep->nwaypts; i++) {
+        if (ip->filep->waypt[i].symbol[0] == '\0')
+            continue;
+        for (int j = 0; j < ip->filep->nwaypts; j++) {
+            GpWaypt *wp = ip->filep->waypt + j;
+            if (wp->symbol[0] == '\0') {
+                free(wp->symbol);
+                wp->symbol = newstr("Waypoint");
+            }
+        }
+        break;
+    }
+    return status;
+}
+
+
+/*  Append the character data of the entity reference after '&' in gpf to
+    text, which holds *n of GP_MAXLINE bytes  */
+static void getGpxEntity( FILE *const gpf, char *text, int *n ) {
+
+    char name[12];
+    long code = -1;
+    int len = 0, c;
+
+    while ((c = getc_unlocked(gpf)) != ';' && c != EOF && c != '<'
+           && len < sizeof(name) - 1)
+        name[len++] = c;
+    name[len] = '\0';
+    if (c == '<')
+        ungetc(c, gpf);
+
+    if (strcmp(name, "amp") == 0)
+        code = '&';
+    else if (strcmp(name, "lt") == 0)
+        code = '<';
+    else if (strcmp(name, "gt") == 0)
+        code = '>';
+    else if (strcmp(name, "quot") == 0)
+        code = '"';
+    else if (strcmp(name, "apos") == 0)
+        code = '\'';
+    else if (name[0] == '#')
+        code = (name[1] == 'x') ? strtol(name + 2, NULL, 16)
+                                : strtol(name + 1, NULL, 10);
+
+    // as UTF-8, leaving room for the '\0'
+    if (code < 0 || code > 0x10FFFF || *n > GP_MAXLINE - 5)
+        return;
+    if (code < 0x80) {
+        text[(*n)++] = code;
+    }
+    else if (code < 0x800) {
+        text[(*n)++] = 0xC0 | code >> 6;
+        text[(*n)++] = 0x80 | (code & 0x3F);
+    }
+    else if (code < 0x10000) {
+        text[(*n)++] = 0xE0 | code >> 12;
+        text[(*n)++] = 0x80 | (code >> 6 & 0x3F);
+        text[(*n)++] = 0x80 | (code & 0x3F);
+    }
+    else {
+        text[(*n)++] = 0xF0 | code >> 18;
+        text[(*n)++] = 0x80 | (code >> 12 & 0x3F);
+        text[(*n)++] = 0x80 | (code >> 6 & 0x3F);
+        text[(*n)++] = 0x80 | (code & 0x3F);
+    }
+}
+
+
+/*  Skip gpf past the next occurrence of end, counting lines in *lineno.
+    Returns:    0 at the end of the file, 1 otherwise  */
+static int skipGpxPast( FILE *const gpf, const char *end, int *lineno ) {
+
+    int len = strlen(end), matched = 0, c;
+
+    while (matched < len && (c = getc_unlocked(gpf)) != EOF) {
+        if (c == '\n')
+            (*lineno)++;
+        if (c == end[matched])
+            matched++;
+        else
+            matched = (c == end[0]) ? 1 : 0;
+    }
+    return matched == len;
+}
+
+
+/*  Read the character data up to the next tag of a GPX file into text, and
+    the tag, without its '<' and '>', into tag (each truncated to GP_MAXLINE).
+    Comments, processing instructions and declarations are skipped, and CDATA
+    sections are added to text as they are.
+    Returns:    0 at the end of the file, 1 otherwise  */
+static int getGpxTag( FILE *const gpf, char *text, char *tag, int *lineno ) {
+
+    int n = 0, m = 0, c;
+    char quote = 0;
+
+    for (;;) {
+        while ((c = getc_unlocked(gpf)) != '<' && c != EOF) {
+            if (c == '\n')
+                (*lineno)++;
+            if (c == '&')
+                getGpxEntity(gpf, text, &n);
+            else if (n < GP_MAXLINE - 1)
+                text[n++] = c;
+        }
+        text[n] = '\0';
+        if (c == EOF)
+            return 0;
+
+        c = getc_unlocked(gpf);
+        if (c == '?') {
+            if (skipGpxPast(gpf, "?>", lineno) == 0)
+                return 0;
+        }
+        else if (c == '!') {
+            char start[8] = "";
+            int len = 0;
+            while (len < 7 && (c = getc_unlocked(gpf)) != EOF && c != '>') {
+                start[len++] = c;
+                start[len] = '\0';
+                if (strcmp(start, "--") == 0 || strcmp(start, "[CDATA[") == 0)
+                    break;
+            }
+            if (strcmp(start, "--") == 0) {
+                if (skipGpxPast(gpf, "-->", lineno) == 0)
+                    return 0;
+            }
+            else if (strcmp(start, "[CDATA[") == 0) {
+                int matched = 0;
+                while (matched < 3 && (c = getc_unlocked(gpf)) != EOF) {
+                    if (c == '\n')
+                        (*lineno)++;
+                    if (c == "]]>"[matched]) {
+                        matched++;
+                        continue;
+                    }
+                    for (int i = 0; i < matched && n < GP_MAXLINE - 1; i++)
+                        text[n++] = ']';
+                    matched = 0;
+                    if (c == ']')
+                        matched = 1;
+                    else if (n < GP_MAXLINE - 1)
+                        text[n++] = c;
+                }
+                if (c == EOF)
+                    return 0;
+            }
+            else if (c != '>' && skipGpxPast(gpf, ">", lineno) == 0) {
+                return 0;
+            }
+        }
+        else {
+            while (c != EOF && (c != '>' || quote != 0)) {
+                if (c == '\n')
+                    (*lineno)++;
+                if (c == '"' || c == '\'')
+                    quote = (quote == 0) ? c : (quote == c) ? 0 : quote;
+                if (m < GP_MAXLINE - 1)
+                    tag[m++] = c;
+                c = getc_unlocked(gpf);
+            }
+            tag[m] = '\0';
+            return c != EOF;
+        }
+    }
+}
+
+
+/*  Copy the value of attribute name in tag into value.
+    Returns:    0 if tag has no such attribute, 1 otherwise  */
+static int getGpxAttr( const char *tag, const char *name, char *value ) {
+
+    int len = strlen(name);
+    const char *p = tag + strcspn(tag, " \t\r\n");
+
+    while (*p != '\0') {
+        p += strspn(p, " \t\r\n");
+        const char *attr = p;
+        p += strcspn(p, "= \t\r\n");
+        const char *end = p;
+        p += strspn(p, " \t\r\n");
+        if (*p != '=')
+            continue;
+        p += 1 + strspn(p + 1, " \t\r\n");
+        if (*p != '"' && *p != '\'')
+            return 0;
+        const char *close = strchr(p + 1, *p);
+        if (close == NULL)
+            return 0;
+        if (end - attr == len && strncmp(attr, name, len) == 0) {
+            memcpy(value, p + 1, close - p - 1);
+            value[close - p - 1] = '\0';
+            return 1;
+        }
+        p = close + 1;
+    }
+    return 0;
+}
+
+
+typedef enum {      // GPX elements holding the data read
+    GPX_OTHER = 0,      // gpx, metadata and anything unknown
+    GPX_WPT,
+    GPX_RTE,
+    GPX_RTEPT,
+    GPX_TRK,
+    GPX_TRKPT
+} GpxElement;
+
+
+GpStatus readGpGpx( FILE *const gpf, GpFile *filep ) {
+
+    GpImport im;
+    GpStatus status = { OK, 1 };
+    GpxElement in = GPX_OTHER;
+    char text[GP_MAXLINE], tag[GP_MAXLINE], value[GP_MAXLINE];
+    char name[GP_MAXLINE] = "", cmt[GP_MAXLINE] = "", sym[GP_MAXLINE] = "";
+    char trkName[GP_MAXLINE] = "";     // of the track or route
+    GpCoord coord = { 0, 0 };
+    double ele = NAN;
+    time_t dateTime = 0;
+    _Bool timed = false, newSeg = false;
+    int skip = 0;   // depth inside extensions & metadata
+
+    initGpImport(&im, filep);
+    while (status.code == OK && getGpxTag(gpf, text, tag, &status.lineno)) {
+        _Bool closing = (tag[0] == '/');
+        _Bool empty = (tag[0] != '\0' && tag[strlen(tag) - 1] == '/');
+        char el[MAX_FIELD_LENGTH], *colon;
+        int len = strcspn(tag + closing, " \t\r\n/");
+
+        // element name, without its namespace prefix
+        sprintf(el, "%.*s", MIN(len, MAX_FIELD_LENGTH - 1), tag + closing);
+        if ( (colon = strchr(el, ':')) != NULL)
+            memmove(el, colon + 1, strlen(colon));
+
+        if (strcmp(el, "extensions") == 0 || strcmp(el, "metadata") == 0) {
+            skip += (closing == true) ? -1 : (empty == false);
+            continue;
+        }
+        if (skip > 0)
+            continue;
+
+        if (closing == false) {
+            if (strcmp(el, "wpt") == 0 || strcmp(el, "rtept") == 0
+                || strcmp(el, "trkpt") == 0) {
+                if (getGpxAttr(tag, "lat", value) == 0
+                    || parseGpNumber(value, &coord.lat) == 0
+                    || getGpxAttr(tag, "lon", value) == 0
+                    || parseGpNumber(value, &coord.lon) == 0
+                    || fabs(coord.lat) > 90 || fabs(coord.lon) > 180) {
+                    status.code = COORD;
+                    break;
+                }
+                name[0] = cmt[0] = sym[0] = '\0';
+                ele = NAN;
+                timed = false;
+                in = (el[0] == 'w') ? GPX_WPT : (el[0] == 'r') ? GPX_RTEPT
+                                                               : GPX_TRKPT;
+            }
+            else if (strcmp(el, "rte") == 0) {
+                trkName[0] = '\0';
+                startGpImportRoute(&im, 0, "");
+                in = GPX_RTE;
+            }
+            else if (strcmp(el, "trk") == 0) {
+                trkName[0] = '\0';
+                newSeg = true;
+                in = GPX_TRK;
+            }
+            else if (strcmp(el, "trkseg") == 0) {
+                newSeg = true;
+            }
+            if (empty == false)
+                continue;
+        }
+
+        // end of an element
+        if (strcmp(el, "name") == 0 || strcmp(el, "cmt") == 0
+            || strcmp(el, "desc") == 0) {
+            _Bool owner = (in == GPX_TRK || in == GPX_RTE);
+            char *dst = owner ? trkName : (el[0] == 'n') ? name : cmt;
+            // a name is kept over a comment, and either over a description
+            if (el[0] == 'n' || dst[0] == '\0'
+                || (el[0] == 'c' && owner == false))
+                strcpy(dst, text);
+            if (in == GPX_RTE) {
+                free(im.route->comment);
+                im.route->comment = newGpField(dst, false);
+            }
+        }
+        else if (strcmp(el, "sym") == 0) {
+            strcpy(sym, text);
+        }
+        else if (strcmp(el, "ele") == 0) {
+            if (parseGpNumber(text, &ele) == 0) {
+                status.code = VALUE;
+                break;
+            }
+        }
+        else if (strcmp(el, "time") == 0 && in == GPX_TRKPT) {
+            if (parseGpIsoTime(text + strspn(text, " \t\r\n"), &dateTime)
+                == 0) {
+                status.code = VALUE;
+                break;
+            }
+            timed = true;
+        }
+        else if (strcmp(el, "number") == 0 && in == GPX_RTE) {
+            im.route->number = atoi(text);
+        }
+        else if (strcmp(el, "wpt") == 0) {
+            addGpImportWaypt(&im, name, coord, sym, cmt);
+            in = GPX_OTHER;
+        }
+        else if (strcmp(el, "rtept") == 0) {
+            addGpImportLeg(&im, name, coord);
+            in = GPX_RTE;
+        }
+        else if (strcmp(el, "trkpt") == 0) {
+            if (timed == false) {
+                status.code = FIELD;    // GPSU trackpoints need a time
+                break;
+            }
+            addGpImportTrkpt(&im, coord, dateTime, ele, newSeg, trkName);
+            newSeg = false;
+            in = GPX_TRK;
+        }
+        else if (strcmp(el, "rte") == 0) {
+            status.code = endGpImportRoute(&im);
+            in = GPX_OTHER;
+        }
+        else if (strcmp(el, "trk") == 0) {
+            in = GPX_OTHER;
+        }
+    }
+    if (status.code == OK && ferror(gpf) != 0)
+        status.code = IOERR;
+    return endGpImport(&im, status);
+}
 
-    // write waypoints, if any
-    if (filep->nwaypts > 0) {
-        GPRINTLN("\n");
-        // determine waypoint F line column sizes
-        for (int i = 0; i < filep->nwaypts; i++) {
-            if (strlen(filep->waypt[i].ID) > id_len)
-                id_len = strlen(filep->waypt[i].ID);
-            if (strlen(filep->waypt[i].symbol) > sym_len)
-                sym_len = strlen(filep->waypt[i].symbol);
-            if (strlen(filep->waypt[i].comment) > com_len)
-                com_len = strlen(filep->waypt[i].comment);
+
+#define GP_CSVCOLS 11   // columns of the CSV form of a GPSU file
+
+// names of the dist & speed columns, by unitHorz
+static const char *gpCsvUnits[][2] = {
+    ['M'] = { "dist_m", "speed_mps" }, ['K'] = { "dist_km", "speed_kmh" },
+    ['F'] = { "dist_ft", "speed_fps" }, ['N'] = { "dist_nm", "speed_kn" },
+    ['S'] = { "dist_mi", "speed_mph" }
+};
+
+/*  Split a CSV line in place into GP_CSVCOLS fields, removing any quotes,
+    missing fields being "" and extra ones ignored.
+    Returns:    -1 for a badly quoted field, the no. of fields otherwise  */
+static int splitGpCsv( char *line, char **field ) {
+
+    char *p = line, sep;
+    int n = 0;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    do {
+        char *out = field[n] = p;
+        if (*p == '"') {
+            for (p++; *p != '"' || p[1] == '"'; p++) {
+                if (*p == '\0')
+                    return -1;
+                if (*p == '"')
+                    p++;
+                *out++ = *p;
+            }
+            if (*++p != ',' && *p != '\0')
+                return -1;
         }
-        
-        // print waypoint F line
-        GPRINT("F ID");
-        for (int i = strlen("ID"); i < id_len; i++)
-            GPRINT("-");
-        GPRINT(" %-*s %-*s T O  ", LATLEN, "Latitude", LONLEN, "Longitude");
-        if (sym_len > 0) {
-            GPRINT("Symbol");
-            for (int i = strlen("Symbol"); i < sym_len; i++)
-                GPRINT("-");
+        else {
+            while (*p != ',' && *p != '\0')
+                *out++ = *p++;
         }
-        if (com_len > 0)
-            GPRINT(" Comment");
-        GPRINTLN("\n");
+        sep = *p++;
+        *out = '\0';
+        n++;
+    } while (sep == ',' && n < GP_CSVCOLS);
 
-        // print waypoints
-        for (int i = 0; i < filep->nwaypts; i++) {
-            char textPlace[][3] ={ "N", "NE", "E", "SE", "S", "SW", "W", "NW" };
-            GpWaypt wp = filep->waypt[i];
-            GPRINT("W %-*s ", id_len, wp.ID);
-            
-            coordToStr(buf, wp.coord);
-            GPRINT("%s %c %-2s", buf, wp.textChoice, textPlace[wp.textPlace]);
-            
-            if (sym_len > 0)
-                GPRINT(" %-*s", sym_len, wp.symbol);
+    for (int i = n; i < GP_CSVCOLS; i++)
+        field[i] = "";
+    return n;
+}
 
-            if (com_len > 0)
-                GPRINT(" %s", wp.comment);
-            GPRINTLN("\n");
-        }    
-    }
-    // write routes, if any
-    for (int i = 0; i < filep->nroutes; i++) {
-        GpRoute *rp = *(filep->route + i);
-        id_len = 0;
-        GPRINTLN("\n");
-        // determine routes F line column sizes
-        for (int j = 0; j < rp->npoints; j++) {
-            if (strlen(filep->waypt[rp->leg[j]].ID) > id_len)
-                id_len = strlen(filep->waypt[rp->leg[j]].ID);
+
+GpStatus readGpCsv( FILE *const gpf, GpFile *filep ) {
+
+    GpImport im;
+    GpStatus status = { OK, 0 };
+    char line[GP_MAXLINE], *field[GP_CSVCOLS];
+    char seg[GP_MAXLINE] = "";  // id of the segment being read
+    _Bool inSeg = false;
+
+    initGpImport(&im, filep);
+    while (status.code == OK && fgets(line, GP_MAXLINE, gpf) != NULL) {
+        GpCoord coord;
+        char type;
+
+        status.lineno++;
+        if (strchr(line, '\n') == NULL && feof(gpf) == 0) {
+            status.code = FIELD;    // line too long
+            break;
+        }
+        if (line[strspn(line, " \t\r\n")] == '\0')
+            continue;
+        if (splitGpCsv(line, field) == -1) {
+            status.code = BADSEP;
+            break;
+        }
+        if (status.lineno == 1 && strcmp(field[0], "type") == 0) {
+            // units of the header's dist column, km. if it has none
+            for (const char *u = "MKFNS"; *u != '\0'; u++) {
+                if (strcmp(field[6], gpCsvUnits[(int)*u][0]) == 0) {
+                    filep->unitHorz = *u;
+                    filep->unitTime = chrset(*u, "FM") ? 'S' : 'H';
+                }
+            }
+            continue;
         }
-        // print R line
-        GPRINTLN("R %.2d %s\n", rp->number, rp->comment);
-        // print routes F line
-        GPRINT("F ID");
-        for (int i = strlen("ID"); i < id_len; i++)
-            GPRINT("-");
 
-        GPRINTLN("\n");
-        
-        // print route waypoints
-        for (int j = 0; j < rp->npoints; j++)
-            GPRINTLN("W %-*s\n", id_len, filep->waypt[rp->leg[j]].ID);
+        type = toupper((unsigned char)field[0][0]);
+        if (strlen(field[0]) != 1 || chrset(type, "WRLT") == false) {
+            status.code = UNKREC;
+            break;
+        }
+        if (type != 'L' && (status.code = endGpImportRoute(&im)) != OK)
+            break;
+        if (type != 'R' && (parseGpNumber(field[2], &coord.lat) == 0
+                            || parseGpNumber(field[3], &coord.lon) == 0
+                            || fabs(coord.lat) > 90
+                            || fabs(coord.lon) > 180)) {
+            status.code = COORD;
+            break;
+        }
+
+        if (type == 'W') {
+            GpWaypt *wp;
+            int w = addGpImportWaypt(&im, field[1], coord, field[8],
+                                     field[10]);
+            wp = filep->waypt + w;
+            if (field[9][0] != '\0') {
+                char textPlace[][3] = { "N", "NE", "E", "SE",
+                                        "S", "SW", "W", "NW" };
+                wp->textPlace = -1;
+                for (int j = 0; j < 8; j++) {
+                    if (strcmp(textPlace[j], field[9] + 1) == 0)
+                        wp->textPlace = j;
+                }
+                wp->textChoice = field[9][0];
+                if (chrset(wp->textChoice, "-IC&+^") == false
+                    || wp->textPlace == -1) {
+                    wp->textPlace = 2;
+                    status.code = VALUE;
+                }
+            }
+        }
+        else if (type == 'R') {
+            double number;
+            if (parseGpNumber(field[1], &number) == 0 || number < 1
+                || number != (int)number) {
+                status.code = VALUE;
+                break;
+            }
+            startGpImportRoute(&im, (int)number, field[10]);
+        }
+        else if (type == 'L') {
+            if (im.route == NULL) {
+                status.code = NOFORM;   // leg outside any route
+                break;
+            }
+            addGpImportLeg(&im, field[1], coord);
+        }
+        else {
+            double alt = NAN;
+            time_t dateTime;
+            _Bool segFlag = (inSeg == false || strcmp(seg, field[1]) != 0);
+            if (parseGpIsoTime(field[4], &dateTime) == 0
+                || (field[5][0] != '\0' && parseGpNumber(field[5], &alt) == 0)) {
+                status.code = VALUE;
+                break;
+            }
+            addGpImportTrkpt(&im, coord, dateTime, alt, segFlag, field[10]);
+            strcpy(seg, field[1]);
+            inSeg = true;
+        }
     }
+    if (status.code == OK && ferror(gpf) != 0)
+        status.code = IOERR;
+    return endGpImport(&im, status);
+}
 
-    // write track info and trackpoints, if any
-    if (filep->ntrkpts > 0) {
-        GpTrack *tp;
-        int n_tracks = getGpTracks(filep, &tp);
-        char dist_units[][8] = {
-            ['M'] = "m", ['K'] = "km", ['F'] = "ft", ['N'] = "nm",
-            ['S'] = "miles" 
-        };
-        char speed_units[][8] = {
-            ['M'] = "m/s", ['K'] = "km/h", ['F'] = "ft/s", ['N'] = "knots",
-            ['S'] = "mph"
-        };
-        GPRINTLN("\n");
-        
-        // determine track header column sizes
-        struct tm timebuf;
-        int dist_len = strlen(dist_units[(int)filep->unitHorz]);
-        int speed_len = strlen(speed_units[(int)filep->unitHorz]);
-        localtime_r(&filep->trkpt->dateTime, &timebuf);
-        int date_len = strftime(buf, MAX_FIELD_LENGTH, filep->dateFormat, &timebuf);
 
-        for (int i = 0; i < n_tracks; i++) {
-            sprintf(buf, "%lf", (tp + i)->dist);
-            if (strlen(buf) > dist_len)
-                dist_len = strlen(buf);
-            sprintf(buf, "%f", (tp + i)->speed);
-            if (strlen(buf) > speed_len)
-                speed_len = strlen(buf);
-        }
-        
-        // print track header column definitions
-        GPRINTLN("H    Track    Pnts. %-*s Time     StopTime Duration %*s %*s\n",
-                date_len, "Date", dist_len, dist_units[(int)filep->unitHorz],
-                speed_len, speed_units[(int)filep->unitHorz]);
-        
-        // print track H line information
-        for (int i = 0; i < n_tracks; i++) {
-            int npts = (i < n_tracks - 1) 
-                       ? (tp+i+1)->seqno - (tp+i)->seqno - 1
-                       : filep->ntrkpts - (tp+i)->seqno;
+/*  Length of str without trailing blanks  */
+static int trimGpLen( const char *str ) {
 
-            if (localtime_r(&(tp + i)->startTrk, &timebuf) == NULL
-                || strftime(buf, date_len + 1, filep->dateFormat,
-                            &timebuf) == 0
-                || strftime(buf + strlen(buf), TIMELEN + 2, " %X",
-                            &timebuf) == 0
-                || localtime_r(&(tp + i)->endTrk, &timebuf) == NULL
-                || strftime(buf + strlen(buf), TIMELEN + 2, " %X",
-                            &timebuf) == 0) {
-                freep((void **)&tp);
+    int len = strlen(str);
+    while (len > 0 && str[len-1] == ' ')
+        len--;
+    return len;
+}
+
+
+/*  Write str, without trailing blanks, as XML character data  */
+static int writeGpxText( FILE *const gpf, const char *str ) {
+
+    for (const char *end = str + trimGpLen(str); str < end; str++) {
+        if (*str == '&')
+            GPRINT("&amp;")
+        else if (*str == '<')
+            GPRINT("&lt;")
+        else if (*str == '>')
+            GPRINT("&gt;")
+        else if (putc(*str, gpf) == EOF)
+            return 0;
+    }
+    return 1;
+}
+
+
+/*  Write str as the element <el>str</el>, unless it is blank  */
+static int writeGpxElement( FILE *const gpf, const char *el,
+                            const char *str ) {
+
+    if (str == NULL || trimGpLen(str) == 0)
+        return 1;
+    GPRINT("<%s>", el);
+    if (writeGpxText(gpf, str) == 0)
+        return 0;
+    GPRINT("</%s>", el);
+    return 1;
+}
+
+
+/*  Write a trackpoint's time in UTC as ISO 8601, YYYY-MM-DDTHH:MM:SSZ  */
+static void isoGpTime( char *dst, const time_t dateTime ) {
+
+    struct tm tm;
+
+    if (gmtime_r(&dateTime, &tm) == NULL
+        || strftime(dst, MAX_FIELD_LENGTH, "%Y-%m-%dT%H:%M:%SZ", &tm) == 0)
+        strcpy(dst, "1970-01-01T00:00:00Z");
+}
+
+
+int writeGpGpx( FILE *const gpf, const GpFile *filep ) {
+
+    char buf[MAX_FIELD_LENGTH];
+
+    GPRINT("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+           "<gpx version=\"1.1\" creator=\"gpstool\""
+           " xmlns=\"http://www.topografix.com/GPX/1/1\">\n");
+
+    for (int i = 0; i < filep->nwaypts; i++) {
+        const GpWaypt *wp = filep->waypt + i;
+        GPRINT("<wpt lat=\"%.6f\" lon=\"%.6f\">", wp->coord.lat,
+               wp->coord.lon);
+        if (writeGpxElement(gpf, "name", wp->ID) == 0
+            || writeGpxElement(gpf, "cmt", wp->comment) == 0
+            || writeGpxElement(gpf, "sym", wp->symbol) == 0)
+            return 0;
+        GPRINT("</wpt>\n");
+    }
+
+    for (int i = 0; i < filep->nroutes; i++) {
+        const GpRoute *rp = filep->route[i];
+        GPRINT("<rte>");
+        if (writeGpxElement(gpf, "name", rp->comment) == 0)
+            return 0;
+        GPRINT("<number>%d</number>\n", rp->number);
+        for (int j = 0; j < rp->npoints; j++) {
+            const GpWaypt *wp = filep->waypt + rp->leg[j];
+            GPRINT("<rtept lat=\"%.6f\" lon=\"%.6f\">", wp->coord.lat,
+                   wp->coord.lon);
+            if (writeGpxElement(gpf, "name", wp->ID) == 0)
                 return 0;
-            }
-            GPRINTLN("H %8d %8d %s %02d:%02d:%02d %*lf %*f\n",
-                    (tp+i)->seqno, npts, buf, (int)(tp+i)->duration / 3600 % 60,
-                    (int)(tp+i)->duration / 60 % 60, (int)(tp+i)->duration % 60,
-                    dist_len, (tp+i)->dist, speed_len, (tp+i)->speed);
-        }        
-        GPRINTLN("\n");
-        freep((void **)&tp);
+            GPRINT("</rtept>\n");
+        }
+        GPRINT("</rte>\n");
+    }
 
-        // determine trackpoint F line column sizes
-        dist_len = strlen(dist_units[(int)filep->unitHorz]);
-        speed_len = strlen(speed_units[(int)filep->unitHorz]);
-        for (int i = 0; i < filep->ntrkpts; i++) {
-            sprintf(buf, "%lf", filep->trkpt[i].dist);
-            if (strlen(buf) > dist_len)
-                dist_len = strlen(buf);
-            sprintf(buf, "%f", filep->trkpt[i].speed);
-            if (strlen(buf) > speed_len)
-                speed_len = strlen(buf);
+    // a track per GPSU segment
+    for (int i = 0; i < filep->ntrkpts; i++) {
+        const GpTrkpt *tp = filep->trkpt + i;
+        if (tp->segFlag == true || i == 0) {
+            if (i > 0)
+                GPRINT("</trkseg></trk>\n");
+            GPRINT("<trk>");
+            if (writeGpxElement(gpf, "name", tp->comment) == 0)
+                return 0;
+            GPRINT("<trkseg>\n");
         }
+        GPRINT("<trkpt lat=\"%.6f\" lon=\"%.6f\">", tp->coord.lat,
+               tp->coord.lon);
+        if (isnan(tp->alt) == false)
+            GPRINT("<ele>%.1f</ele>", tp->alt);
+        isoGpTime(buf, tp->dateTime);
+        GPRINT("<time>%s</time></trkpt>\n", buf);
+    }
+    if (filep->ntrkpts > 0)
+        GPRINT("</trkseg></trk>\n");
 
-        // print trackpoint F line
-        GPRINTLN("F %-*s %-*s %-*s %-8s S %-8s %*s %*s\n",
-                LATLEN, "Latitude", LONLEN, "Longitude", date_len, "Date",
-                "Time", "Duration", dist_len, dist_units[(int)filep->unitHorz],
-                speed_len, speed_units[(int)filep->unitHorz]);
-        // print trackpoints
-        for (int i = 0; i < filep->ntrkpts; i++) {
-            GpTrkpt tp = filep->trkpt[i];
+    GPRINT("</gpx>\n");
+    return 1;
+}
 
-            coordToStr(buf, tp.coord);
-            strcat(buf, " ");
-            if ( (localtime_r(&tp.dateTime, &timebuf) == NULL)
-                 || (strftime(buf + strlen(buf), date_len + 1, filep->dateFormat,
-                                &timebuf) == 0)
-                 || (strftime(buf + strlen(buf), TIMELEN + 2, " %X",
-                     &timebuf) == 0) )
-                return 0;
 
-            GPRINT("T %s", buf);
+/*  Write str, without trailing blanks, as a CSV field, quoted if it has to be
+ */
+static int writeGpCsvField( FILE *const gpf, const char *str ) {
 
-            if (tp.segFlag == true) {
-                GPRINTLN(" 1 %s\n", tp.comment);
-            }
-            else {
-                GPRINTLN(" 0 %02d:%02d:%02d %*lf %*f\n",
-                        (int)tp.duration / 3600 % 60,
-                        (int)tp.duration / 60 % 60, (int)tp.duration % 60,
-                        dist_len, tp.dist, speed_len, tp.speed);
-            }
-        }        
+    int len = trimGpLen(str);
+
+    if (strcspn(str, ",\"\r\n") >= len)
+        return fwrite(str, 1, len, gpf) == len;
+
+    GPRINT("\"");
+    for (const char *end = str + len; str < end; str++) {
+        if (*str == '"')
+            GPRINT("\"\"")
+        else if (putc(*str, gpf) == EOF)
+            return 0;
     }
-    return COUNT;
+    GPRINT("\"");
+    return 1;
 }
 
+
+int writeGpCsv( FILE *const gpf, const GpFile *filep ) {
+
+    char textPlace[][3] = { "N", "NE", "E", "SE", "S", "SW", "W", "NW" };
+    char buf[MAX_FIELD_LENGTH];
+    int seqno = 0;
+
+    GPRINT("type,id,lat,lon,time,alt,%s,%s,symbol,text,comment\n",
+           gpCsvUnits[(int)filep->unitHorz][0],
+           gpCsvUnits[(int)filep->unitHorz][1]);
+
+    for (int i = 0; i < filep->nwaypts; i++) {
+        const GpWaypt *wp = filep->waypt + i;
+        GPRINT("W,");
+        if (writeGpCsvField(gpf, wp->ID) == 0)
+            return 0;
+        GPRINT(",%.6f,%.6f,,,,,", wp->coord.lat, wp->coord.lon);
+        if (writeGpCsvField(gpf, wp->symbol) == 0)
+            return 0;
+        GPRINT(",%c%s,", wp->textChoice, textPlace[wp->textPlace]);
+        if (writeGpCsvField(gpf, wp->comment) == 0)
+            return 0;
+        GPRINT("\n");
+    }
+
+    for (int i = 0; i < filep->nroutes; i++) {
+        const GpRoute *rp = filep->route[i];
+        GPRINT("R,%d,,,,,,,,,", rp->number);
+        if (writeGpCsvField(gpf, rp->comment) == 0)
+            return 0;
+        GPRINT("\n");
+        for (int j = 0; j < rp->npoints; j++) {
+            const GpWaypt *wp = filep->waypt + rp->leg[j];
+            GPRINT("L,");
+            if (writeGpCsvField(gpf, wp->ID) == 0)
+                return 0;
+            GPRINT(",%.6f,%.6f,,,,,,,\n", wp->coord.lat, wp->coord.lon);
+        }
+    }
+
+    // id of a trackpoint is its track's seqno
+    for (int i = 0; i < filep->ntrkpts; i++) {
+        const GpTrkpt *tp = filep->trkpt + i;
+        if (tp->segFlag == true || i == 0)
+            seqno = i + 1;
+        isoGpTime(buf, tp->dateTime);
+        GPRINT("T,%d,%.6f,%.6f,%s,", seqno, tp->coord.lat, tp->coord.lon, buf);
+        if (isnan(tp->alt) == false)
+            GPRINT("%.1f", tp->alt);
+        GPRINT(",%f,%f,,,", tp->dist, tp->speed);
+        if (tp->segFlag == true && writeGpCsvField(gpf, tp->comment) == 0)
+            return 0;
+        GPRINT("\n");
+    }
+    return 1;
+}
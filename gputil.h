@@ -11,6 +11,7 @@ Eric Coutu
 
 #include <stdio.h>
 #include <time.h>
+#include <stdint.h>
 
 typedef struct {    // lat-long coordinate, assume WGS 84 datum
     double lat,lon;     // fractional degrees, S & W < 0
@@ -44,6 +45,7 @@ typedef struct {    // trackpoint
     float speed;        // average speed from previous point
     double dist;        // distance from previous point
     long duration;      // elapsed time since start of segment (sec.)
+    double alt;         // altitude as in file's Alt field, NAN if none
 } GpTrkpt;
 
 typedef struct {    // track
@@ -109,6 +111,7 @@ typedef struct {
 /* File I/O functions */
 
 GpStatus readGpFile( FILE *const gpf, GpFile *filep );
+int readGpFileLenient( FILE *const gpf, GpFile *filep, GpStatus **diag );
 GpError scanGpWaypt( const char *buff, const char *fieldDef, GpWaypt *wp );
 GpError scanGpRoute( const char *buff, GpRoute *rp );
 GpError scanGpLeg( const char *buff, const char *fieldDef, const GpWaypt *wp,
@@ -120,10 +123,309 @@ void freeGpRoutes(GpFile *filep);
 void freeGpWaypts(GpFile *filep);
 void freeGpTrkpts(GpFile *filep);
 int writeGpFile( FILE *const gpf, const GpFile *filep );
+void coordToStr( char *dst, GpCoord coord );
+
+
+/* Resumable reading of a file that is still being written */
+
+#define GP_MAXLINE 1024     // longest line read, longer ones are split
+
+typedef struct {    // where reading a GPSU file left off
+    long offset;        // byte offset of the first line not yet read
+    int lineno;         // its line no.
+    char fieldDef[GP_MAXLINE];  // last 'F' line
+    _Bool isRoute;      // 'W' lines are route legs
+    _Bool badRoute;     //  of a route in error, to be skipped
+    _Bool trkptSkipped; // a trackpoint line in error was skipped, so the
+                        //  next trackpoint starts a segment
+    double baseDist;    // dist & duration read of the trackpoint starting
+    long baseDuration;  //  the segment so, which the rest are rebased to
+    int ntrkpts;        // no. of trackpoints summarized in fol'g array
+    int ntracks;        // no. of tracks, the last one may still grow
+    GpTrack *track;     // summaries as from getGpTracks
+} GpReader;
+
+void initGpReader( GpReader *reader, GpFile *filep );
+GpStatus resumeGpFile( FILE *const gpf, GpReader *reader, GpFile *filep );
+void freeGpReader( GpReader *reader );
+
+
+/* Compressed streams, read transparently by readGpFile */
+
+typedef enum {
+    GP_PLAIN = 0,   // not compressed
+    GP_GZIP         // gzip (RFC 1952)
+} GpCompression;
+
+FILE *openGpInput( FILE *const fp, GpCompression *how );
+FILE *openGpOutput( FILE *const fp, const GpCompression how );
+
+
+/* Quick summary without reading the whole file into memory */
+
+typedef struct {    // counts & extent of a GPSU file
+    int nwaypts, nroutes, ntrkpts, ntracks;
+    _Bool sorted;       // waypoint IDs in ascending order
+    GpCoord NEcorner;   // farthest NE waypoint or track position
+    GpCoord SWcorner;   // farthest SW
+} GpFileInfo;
+
+GpStatus scanGpFileInfo( FILE *const gpf, GpFileInfo *info );
+
+
+/* Profiling, counted only when gputil is built with -DGP_PROFILE */
+
+typedef enum {      // phases timed; LINES to LEGS are parts of READ
+    GP_PROF_READ = 0,   // readGpFile or scanGpFileInfo as a whole
+    GP_PROF_LINES,      // reading lines
+    GP_PROF_FIELDDEF,   // parsing 'F' field definitions
+    GP_PROF_SPLIT,      // splitting lines into fields
+    GP_PROF_COORDS,     // parsing coordinates
+    GP_PROF_TIMES,      // parsing dates & times (strptime, mktime)
+    GP_PROF_ALLOC,      // growing arrays & copying strings
+    GP_PROF_LEGS,       // finding route legs' waypoints
+    GP_PROF_WRITE,      // writeGpFile as a whole
+    GP_PROF_NPHASES
+} GpProfPhase;
+
+typedef struct {    // counters since the program started
+    long long ns[GP_PROF_NPHASES];  // elapsed time per phase (nanosec.)
+    long calls[GP_PROF_NPHASES];    // no. of times each phase was timed
+    long nallocs;       // no. of allocations while reading
+    long long allocBytes;   // total bytes requested by them
+} GpProfile;
+
+_Bool getGpProfile( GpProfile *prof );
+int writeGpProfile( FILE *const gpf, const GpProfile *prof );
+
+
+/* Map overlay export */
+
+typedef struct {    // components to write as map data
+    _Bool waypts;       // all waypoints
+    _Bool trkpts;       // all trackpoints
+    int nroutes;        // no. of routes in fol'g array, -1 for all routes
+    int *route;         // route numbers
+    int ntracks;        // no. of tracks in fol'g array, -1 for all tracks
+    int *track;         // track sequence numbers
+    double tolerance;   // trackpoint simplification (unitHorz), 0 for none
+} GpMapSpec;
+
+int writeGpPolyline( FILE *const gpf, const GpCoord *coord, const int n );
+int writeGpMapData( FILE *const gpf, const GpFile *filep,
+    const GpMapSpec *spec );
+
+
+/* Tile pyramid for map serving (Web Mercator tiles, 256 pixels square) */
+
+#define GP_MAXZOOM 16       // deepest zoom level built
+
+typedef struct {    // tile at one zoom level
+    int zoom;           // zoom level, 0 = whole world in one tile
+    long x, y;          // column & row of tile, from NW corner
+    int npoints;        // no. of entries in fol'g array
+    int *point;         // trackpoint subscripts of the track lines crossing
+                        //  the tile, each line preceded by -(track seqno)
+} GpTile;
+
+int getGpTiles( const GpFile *filep, const int zoom, const _Bool *keep,
+    GpTile **tiles );
+int writeGpTile( FILE *const gpf, const GpFile *filep, const GpTile *tile );
+void freeGpTiles( GpTile *tiles, const int ntiles );
+
+
+/* Columnar trackpoint export, for mapping straight into numeric code
+
+   File layout, in the host's byte order:
+     GpColHeader
+     GpColChunk[nchunks]    directory, with each column's min & max so
+                            readers can skip chunks a predicate rules out
+     chunk data             per chunk, the columns in GpColumn order, each
+                            an array of nrows values padded to 8 bytes:
+                            lat, lon, dist: double; time: int64_t (sec.);
+                            speed: float; seg: int32_t (track seqno, 0 for
+                            trackpoints before the first track) */
+
+#define GP_COLMAGIC "GPSCOL1"   // with its '\0', the first 8 bytes
+#define GP_COLCHUNK 65536       // trackpoints per chunk (the last may be short)
+
+typedef enum {
+    GP_COL_LAT = 0,
+    GP_COL_LON,
+    GP_COL_TIME,
+    GP_COL_DIST,
+    GP_COL_SPEED,
+    GP_COL_SEG,
+    GP_NCOLS
+} GpColumn;
+
+typedef struct {    // start of a columnar file (32 bytes)
+    char magic[8];      // GP_COLMAGIC
+    int32_t byteOrder;  // 0x01020304 as written by the host
+    int32_t nchunks;    // no. of GpColChunk entries that follow
+    int64_t nrows;      // no. of trackpoints
+    char unitHorz;      // units of dist & speed, as in GpFile
+    char unitTime;
+    char pad[6];
+} GpColHeader;
+
+typedef struct {    // chunk directory entry (112 bytes)
+    int64_t offset;     // file offset of the chunk's lat column
+    int32_t nrows;      // no. of trackpoints in the chunk
+    int32_t pad;
+    double min[GP_NCOLS];   // smallest & largest value of each column
+    double max[GP_NCOLS];
+} GpColChunk;
+
+int writeGpColumns( FILE *const gpf, const GpFile *filep );
+
+
+/* GPX 1.1 & CSV conversion, read in one pass; each GPSU segment is a GPX
+   <trk>, and trackpoints' distances, speeds & durations are derived on
+   reading (times are UTC in both formats)
+
+   CSV columns: type,id,lat,lon,time,alt,dist,speed,symbol,text,comment
+   with dist & speed named for the file's units, e.g. dist_km,speed_kmh
+     W  waypoint: ID, position, symbol, text choice & place (e.g. IE), comment
+     R  route: no., comment; followed by its legs
+     L  route leg: waypoint ID & position
+     T  trackpoint: track seqno, position, time, alt, dist, speed, and the
+        segment's comment on its first trackpoint */
+
+GpStatus readGpGpx( FILE *const gpf, GpFile *filep );
+GpStatus readGpCsv( FILE *const gpf, GpFile *filep );
+int writeGpGpx( FILE *const gpf, const GpFile *filep );
+int writeGpCsv( FILE *const gpf, const GpFile *filep );
 
 
 /* File interpretation functions */
 
 int getGpTracks( const GpFile *filep, GpTrack **tp );
 
+#define GP_HASHQUANT 1e-6   // position quantum of track hashes (deg.)
+
+int getGpTrackHashes( const GpFile *filep, uint64_t **hash );
+
+
+/* Distance functions (great-circle, spherical earth) */
+
+#define GP_EARTH_RADIUS 6371.01     // mean radius of the earth (km.)
+
+double getGpUnitFactor( const char unitHorz );
+double getGpDistance( const GpCoord from, const GpCoord to );
+void getGpDistances( const GpCoord *from, const GpCoord *to, const int n,
+    double *dist );
+void getGpLegDists( const GpCoord *coord, const int n, double *dist );
+
+
+/* Extended track statistics */
+
+typedef struct {    // statistics of one track, see getGpTrackStats()
+    int seqno;          // sequence no. of track (=trackpt subscript+1)
+    int npoints;        // no. of trackpoints in track
+    long movingTime;    // time spent on legs faster than the stop speed (sec.)
+    long stoppedTime;   // time spent on the other legs (sec.)
+    float movingSpeed;  // average speed while moving
+    float maxSpeed;     // highest leg speed
+    float pctSpeed;     // leg speed at the requested percentile
+    double climb;       // total altitude gained, 0 without altitudes
+    double descent;     // total altitude lost, 0 without altitudes
+    double minAlt, maxAlt;  // altitude range, NAN without altitudes
+} GpTrackStats;
+
+int getGpTrackStats( const GpFile *filep, const float stopSpeed,
+    const double percentile, GpTrackStats **sp );
+
+
+/* Track simplification (Douglas-Peucker) */
+
+int simplifyGpPath( const GpCoord *coord, const int n, const double tolerance,
+    _Bool *keep );
+int simplifyGpTrkpts( const GpFile *filep, const double tolerance,
+    _Bool *keep );
+
+
+/* Trackpoint selection & editing */
+
+typedef struct {    // trackpoints to select, see selectGpTrkpts()
+    _Bool byTime;       // only trackpoints timed from..to (inclusive)
+    time_t from, to;
+    _Bool byBox;        // only trackpoints inside SWcorner..NEcorner
+    GpCoord SWcorner, NEcorner;
+} GpTrkptFilter;
+
+int parseGpTrkptFilter( const char *str, GpTrkptFilter *filter );
+_Bool overlapsGpTrack( const GpTrack *track, const GpTrkptFilter *filter );
+int selectGpTrkpts( const GpFile *filep, const GpTrkptFilter *filter,
+    _Bool *keep );
+int keepGpTrkpts( GpFile *filep, const _Bool *keep );
+int resampleGpTrkpts( const GpFile *filep, const char mode, const double step,
+    GpTrkpt **tp );
+
+typedef struct {    // derived trackpoint fields found off by checkGpTrkpts()
+    int npoints;        // no. of trackpoints with any field off
+    int ndist, nspeed, nduration;   // no. of trackpoints with each field off
+    double maxDist;     // largest distance error (unitHorz)
+    double maxSpeed;    // largest speed error (unitHorz per unitTime)
+    long maxDuration;   // largest duration error (sec.)
+    int first;          // subscript of first trackpoint off, -1 for none
+} GpTrkptCheck;
+
+int checkGpTrkpts( GpFile *filep, const double tolerance, const _Bool fix,
+    GpTrkptCheck *cp );
+
+typedef struct {    // where splitGpTracks() starts new segments, 0 = never
+    long maxGap;        // time between trackpoints over this (sec.)
+    long minStop;       // stationary at least this long (sec.), within
+    double stopRadius;  //  this distance (unitHorz) of where it stopped
+    double maxJump;     // distance between trackpoints over this (unitHorz)
+} GpSplitSpec;
+
+int splitGpTracks( GpFile *filep, const GpSplitSpec *spec );
+int mergeGpTrkpts( const GpFile *filep, const GpFile *filepB,
+    const long dupTime, const double dupDist, GpTrkpt **tp );
+
+
+/* Waypoint sorting */
+
+typedef struct {    // waypoint sort key, see sortGpWaypts()
+    char field;         // {i,s,c,d,h} ID, symbol, comment, distance from
+                        //  centre, or position along a Hilbert curve
+    GpCoord centre;     // for field d
+} GpSortKey;
+
+int sortGpWaypts( GpFile *filep, const GpSortKey *key, const int nkeys );
+
+
+/* Spatial index over waypoints and trackpoints */
+
+#define GP_CELLSIZE 0.01    // default index cell size (deg.), about 1 km.
+
+typedef struct {    // indexed point
+    long cell;          // grid cell (row * ncols + column)
+    GpCoord coord;      // coordinate
+    _Bool isTrkpt;      // true for a trackpoint, false for a waypoint
+    int index;          // subscript in array of waypoints or trackpoints
+} GpIndexEntry;
+
+typedef struct {    // grid index, entries sorted by cell
+    double cellSize;    // width & height of a cell (deg.)
+    long ncols;         // no. of cells in a row
+    int nentries;       // no. of entries (=size of fol'g array)
+    GpIndexEntry *entry;
+} GpIndex;
+
+typedef struct {    // point found by a query
+    _Bool isTrkpt;      // true for a trackpoint, false for a waypoint
+    int index;          // subscript in array of waypoints or trackpoints
+    double dist;        // distance from query point in km. (0 for boxes)
+} GpMatch;
+
+void buildGpIndex( const GpFile *filep, const double cellSize, GpIndex *ip );
+int queryGpBox( const GpIndex *ip, const GpCoord SW, const GpCoord NE,
+    GpMatch **mp );
+int queryGpRadius( const GpIndex *ip, const GpCoord centre, const double dist,
+    GpMatch **mp );
+void freeGpIndex( GpIndex *ip );
+
 #endif
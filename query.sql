@@ -1,31 +1,19 @@
 SELECT name
-FROM (SELECT hikeno, SUM(distance) AS hdist
-      FROM HIKEPTS GROUP BY hikeno) AS A, HIKE
-WHERE A.hikeno=HIKE.hikeno AND HIKE.location LIKE "%s" AND hdist=(
-    SELECT MIN(h2)
-    FROM (
-        SELECT hikeno, SUM(distance) AS h2
-        FROM HIKEPTS
-        GROUP BY hikeno
-         ) AS B);
+FROM HIKE
+WHERE location LIKE "%(location)s" AND totaldist=(
+    SELECT MIN(totaldist)
+    FROM HIKE
+    WHERE location LIKE "%(location)s");
 SELECT COUNT(hikeno) AS "Number of Hikes"
-FROM (
-    SELECT hikeno, COUNT(leg) AS nlegs
-    FROM HIKEPTS GROUP BY hikeno
-    ) AS A
-WHERE (A.nlegs > %s);
+FROM HIKE
+WHERE (nlegs > %s);
 SELECT name
-FROM (
-    SELECT fileno, ptno, RADIANS(lat) AS flat, RADIANS(lon) AS flon
-    FROM WAYPTS
-     ) AS A, HIKEPTS, HIKE
-WHERE HIKEPTS.ptno=A.ptno AND HIKEPTS.fileno=A.fileno AND leg=0 AND HIKEPTS.hikeno=HIKE.hikeno AND
-ATAN2(
-    SQRT(
-        POW( COS(flat) * SIN(%(slon)f - flon), 2) +
-        POW( COS(%(slat)f) * SIN(flat) - SIN(%(slat)f) * COS(flat) * COS(%(slon)f - flon), 2)),
-    SIN(%(slat)f) * SIN(flat) +
-    COS(%(slat)f) * COS(flat) * COS(%(slon)f - flon)) * 6371.01 < %(dist)f;
+FROM WAYPTS AS A, HIKEPTS, HIKE
+WHERE %(cells)s AND
+      A.lat BETWEEN %(minlat).15g AND %(maxlat).15g AND
+      A.lon BETWEEN %(minlon).15g AND %(maxlon).15g AND
+      HIKEPTS.ptno=A.ptno AND HIKEPTS.fileno=A.fileno AND leg=0 AND HIKEPTS.hikeno=HIKE.hikeno AND
+      A.x * %(sx).15g + A.y * %(sy).15g + A.z * %(sz).15g > %(mincos).15g;
 
 SELECT hike
 
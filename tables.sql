@@ -5,7 +5,15 @@ CREATE TABLE IF NOT EXISTS HIKE (
     comment     VARCHAR(80),
     rating      SMALLINT,
     note        TINYTEXT,
-    PRIMARY KEY (hikeno)
+    totaldist   FLOAT,
+    nlegs       INT,
+    minlat      DOUBLE,
+    minlon      DOUBLE,
+    maxlat      DOUBLE,
+    maxlon      DOUBLE,
+    PRIMARY KEY (hikeno),
+    INDEX (totaldist),
+    INDEX (nlegs)
 )
 CREATE TABLE IF NOT EXISTS WAYPTS (
     fileno      INT,
@@ -14,7 +22,15 @@ CREATE TABLE IF NOT EXISTS WAYPTS (
     comment     VARCHAR(80),
     lat         DOUBLE,
     lon         DOUBLE,
-    PRIMARY KEY (fileno, ptno)
+    rlat        DOUBLE,
+    rlon        DOUBLE,
+    x           DOUBLE,
+    y           DOUBLE,
+    z           DOUBLE,
+    cell        INT,
+    PRIMARY KEY (fileno, ptno),
+    INDEX (lat, lon),
+    INDEX (cell)
 )
 CREATE TABLE IF NOT EXISTS HIKEPTS (
     hikeno      INT,
@@ -23,6 +39,7 @@ CREATE TABLE IF NOT EXISTS HIKEPTS (
     leg         INT,
     distance    FLOAT,
     PRIMARY KEY (hikeno, leg),
+    INDEX (fileno, ptno),
     FOREIGN KEY (hikeno) REFERENCES HIKE,
     FOREIGN KEY (fileno, ptno) REFERENCES WAYPTS
 )
@@ -0,0 +1,110 @@
+#!/bin/sh
+# check.sh -- runs gpstool on the files in tests/ and compares what it writes
+# with the expected output kept beside them
+#
+# Prints one line per check failed and exits 1 if any were.  A check's
+# standard output is compared with tests/NAME and its standard error, with
+# gpstool's path as "gpstool", with tests/NAME.err; a missing file stands for
+# no output.  The round trips compare -info of the file converted and read
+# back with -info of the file itself.
+#
+# Eric Coutu
+# 0523365
+
+GPSTOOL=${GPSTOOL:-./gpstool}
+T=tests
+DIR=${TMPDIR:-/tmp}/gpscheck.$$
+failed=0
+
+# the GPSU writer gives times in the local time zone
+TZ=UTC
+export TZ
+
+mkdir -p "$DIR" || exit 1
+trap 'rm -rf "$DIR"' 0 1 2 15
+
+# same EXPECTED OUTPUT: OUTPUT is what $T/EXPECTED holds, or empty if none
+same() {
+    if [ -f "$T/$1" ]; then
+        cp "$T/$1" "$DIR/want"
+    else
+        : > "$DIR/want"
+    fi
+    if ! cmp -s "$DIR/want" "$2"; then
+        echo "$1: output differs:"
+        diff "$DIR/want" "$2"
+        failed=1
+    fi
+}
+
+# check NAME STATUS COMMAND...: COMMAND writes $T/NAME and $T/NAME.err and
+# exits with STATUS
+check() {
+    name=$1
+    want=$2
+    shift 2
+    "$@" > "$DIR/out" 2> "$DIR/err"
+    got=$?
+    if [ "$got" -ne "$want" ]; then
+        echo "$name: exit status $got, not $want"
+        failed=1
+    fi
+    same "$name" "$DIR/out"
+    sed "s|^$GPSTOOL:|gpstool:|" "$DIR/err" > "$DIR/err.sed"
+    same "$name.err" "$DIR/err.sed"
+}
+
+# -info of FILE imported from FORMAT
+import_info() {
+    $GPSTOOL -import "$1" < "$2" | $GPSTOOL -info
+}
+
+# -info of GPSU FILE exported to FORMAT and imported again
+round_trip() {
+    $GPSTOOL -export "$1" < "$2" | $GPSTOOL -import "$1" | $GPSTOOL -info
+}
+
+# -info of FILE deduped against the hash file $DIR/hashes
+dedupe_info() {
+    $GPSTOOL -dedupe "$DIR/hashes" < "$1" | $GPSTOOL -info
+}
+
+check sample.gpx.gps 0 $GPSTOOL -import gpx < "$T/sample.gpx"
+check sample.csv.gps 0 $GPSTOOL -import csv < "$T/sample.csv"
+check sample.gpx.info 0 import_info gpx "$T/sample.gpx"
+check sample.csv.info 0 import_info csv "$T/sample.csv"
+check notime.gpx.gps 1 $GPSTOOL -import gpx < "$T/notime.gpx"
+check invalid.gps.valid 1 $GPSTOOL -validate < "$T/invalid.gps"
+# lines in error where tracks start, which mustn't join them
+check invalid_seg.gps.valid 1 $GPSTOOL -validate < "$T/invalid_seg.gps"
+
+# the device's own distances & speeds, rounded as written, are not off
+check sample.gps.recompute 0 $GPSTOOL -recompute r < "$T/sample.gps"
+
+# a box across the antimeridian, with a track running outside it between
+# its corners
+check antimeridian.gps.filter 0 $GPSTOOL -filter 0,175,10,-175 \
+    < "$T/antimeridian.gps"
+
+# a second run over the same input finds every track in the hash file
+check sample.gps.dedupe 0 dedupe_info "$T/sample.gps"
+check sample.gps.dedupe2 0 dedupe_info "$T/sample.gps"
+
+for f in "$T/sample.gps" "$T/sample.gpx" "$T/sample.csv"; do
+    case $f in
+    *.gps)  $GPSTOOL -info < "$f" > "$DIR/info" 2>&1 ;;
+    *)      import_info "${f##*.}" "$f" > "$DIR/info" 2>&1
+            $GPSTOOL -import "${f##*.}" < "$f" > "$DIR/in.gps" 2> /dev/null
+            f=$DIR/in.gps ;;
+    esac
+    for fmt in gpx csv; do
+        round_trip $fmt "$f" > "$DIR/trip" 2>&1
+        if ! cmp -s "$DIR/info" "$DIR/trip"; then
+            echo "$f: -info changed by a round trip through $fmt:"
+            diff "$DIR/info" "$DIR/trip"
+            failed=1
+        fi
+    done
+done
+
+exit $failed